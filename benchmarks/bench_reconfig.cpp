@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Measures the latency of each kind of reconfiguration.
+// Usage: ssp_bench_reconfig [device], a pseudo terminal is used when no device is given.
+
+#include <ssp/serial.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+constexpr int iterations = 5000;
+
+template <typename F>
+void measure(std::string const &name, F &&step)
+{
+    std::vector<double> samples(iterations);
+    try {
+        for (auto i = 0; i < iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            step(i);
+            samples[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+    } catch (ssp::SerialErrorConfig const&) {
+        std::cout << std::left << std::setw(36) << name << "not supported by the device" << std::endl;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << samples[iterations / 2]
+              << std::setw(10) << samples[iterations * 99 / 100]
+              << std::setw(10) << samples.back() << std::endl;
+}
+
+}
+
+auto main(int argc, char *argv[]) -> int {
+
+    int master = -1;
+    int slave = -1;
+    std::string device;
+    if (argc > 1) {
+        device = argv[1];
+    } else {
+        char name[64];
+        if (openpty(&master, &slave, name, nullptr, nullptr) < 0) {
+            std::cout << "could not open a pseudo terminal" << std::endl;
+            return 1;
+        }
+        device = name;
+    }
+
+    try {
+        auto base = ssp::PortConfig{}.baud(ssp::Baudrate::_9600);
+        auto port = ssp::SerialPort(device, base);
+        auto fast = ssp::PortConfig{base}.baud(ssp::Baudrate::_19200);
+        auto even = ssp::PortConfig{base}.parity(ssp::Parity::EVEN);
+        auto mode_c = ssp::PortConfig{base}.baud(ssp::Baudrate::_300).parity(ssp::Parity::EVEN).databits(ssp::Databits::_7);
+
+        std::cout << std::left << std::setw(36) << "switch (us)" << std::right
+                  << std::setw(10) << "median" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+        measure("apply, unchanged", [&](int) {
+            port.apply(base);
+        });
+        measure("apply, timeout only", [&](int i) {
+            port.apply(ssp::PortConfig{base}.timeout(i % 2 ? 100 : 2000));
+        });
+        port.apply(base);
+        measure("apply, baud 9600/19200 now", [&](int i) {
+            port.apply(i % 2 ? base : fast);
+        });
+        measure("apply, baud 9600/19200 drain", [&](int i) {
+            port.apply(i % 2 ? base : fast, ssp::ApplyMode::DRAIN);
+        });
+        port.apply(base);
+        measure("apply, parity none/even", [&](int i) {
+            port.apply(i % 2 ? base : even);
+        });
+        port.apply(base);
+        measure("apply, 9600 8N1/300 7E1", [&](int i) {
+            port.apply(i % 2 ? base : mode_c);
+        });
+
+        //reference: a full termios rebuild and write on every change
+        auto fd = port.native_handle();
+        measure("tcsetattr, rebuilt every time", [&](int i) {
+            struct termios params;
+            memset(&params, 0, sizeof(params));
+            params.c_iflag = IGNPAR;
+            params.c_cflag = CREAD | CLOCAL | CRTSCTS | CS8;
+            cfsetispeed(&params, i % 2 ? B9600 : B19200);
+            cfsetospeed(&params, i % 2 ? B9600 : B19200);
+            tcsetattr(fd, TCSANOW, &params);
+        });
+    } catch (std::exception const& e) {
+        std::cout << e.what() << std::endl;
+    }
+
+    if (master >= 0) {
+        close(slave);
+        close(master);
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// Compares formatting traffic with iostreams, as done by the listeners in the examples,
+// against the table driven formatter and the full TrafficLogger pipeline.
+// Usage: ssp_bench_traffic_log [log file], /dev/null is used when no file is given.
+
+#include <ssp/traffic_log.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr int chunks = 200000;
+constexpr size_t chunk_size = 64;
+
+//finish runs inside the timed region, so work left for other threads is counted
+template <typename F, typename G>
+void measure(std::string const &name, F &&step, G &&finish)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < chunks; ++i) {
+        step(i);
+    }
+    finish();
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << chunks * chunk_size / seconds / 1e6 << " MB/s"
+              << std::setw(10) << seconds * 1e9 / chunks << " ns/chunk" << std::endl;
+}
+
+}
+
+auto main(int argc, char *argv[]) -> int {
+
+    auto path = std::string{argc > 1 ? argv[1] : "/dev/null"};
+
+    std::vector<uint8_t> data(chunk_size);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 37);
+    }
+
+    {
+        std::ofstream out(path);
+        measure("iostream, byte by byte", [&](int) {
+            out << "RX: ";
+            for (auto const &b : data) {
+                out << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(b) << ' ';
+            }
+            out << std::endl;
+        }, [&] { out.flush(); });
+    }
+
+    {
+        std::ofstream out(path);
+        std::vector<char> line(4 * chunk_size + 8);
+        measure("format_hex + format_ascii", [&](int) {
+            auto len = ssp::format_hex(data.data(), data.size(), line.data());
+            line[len++] = ' ';
+            len += ssp::format_ascii(data.data(), data.size(), line.data() + len);
+            line[len++] = '\n';
+            out.write(line.data(), len);
+        }, [&] { out.flush(); });
+    }
+
+    {
+        //room for the whole run, so that no event is dropped and every byte is formatted and written
+        auto options = ssp::TrafficLoggerOptions{};
+        options.path = path;
+        options.buffer_bytes = chunks * (chunk_size + 64);
+        auto logger = ssp::TrafficLogger(options);
+        auto tap = logger.tap("bench", ssp::TrafficDirection::RX);
+        measure("TrafficLogger, including flush", [&](int) {
+            tap(data);
+        }, [&] { logger.flush(); });
+        auto stats = logger.stats();
+        std::cout << "TrafficLogger: " << stats.events << " events, " << stats.bytes << " bytes captured, "
+                  << stats.overflows << " overflows, " << stats.write_errors << " write errors, "
+                  << stats.file_writes << " writes" << std::endl;
+        if (stats.overflows != 0) {
+            std::cout << "warning: events were dropped, the result is not comparable" << std::endl;
+        }
+    }
+
+    return 0;
+}
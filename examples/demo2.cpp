@@ -0,0 +1,59 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <ssp/iec62056.h>
+#include <iostream>
+
+auto main(int argc, char *argv[]) -> int {
+
+    auto targets = std::vector<ssp::Iec62056Target>{};
+    for (auto i = 1; i < argc; ++i) {
+        targets.push_back({argv[i], ""});
+    }
+
+    auto results = ssp::iec62056_read_meters(targets);
+
+    for (auto i = 0u; i < results.size(); ++i) {
+        std::cout << targets[i].port << ": ";
+        try {
+            if (results[i].error) {
+                std::rethrow_exception(results[i].error);
+            }
+            auto const &readout = results[i].readout;
+            std::cout << readout.ident.manufacturer << ' ' << readout.ident.identification
+                      << " @ " << static_cast<unsigned>(readout.baudrate) << std::endl;
+            for (auto const &data_set : readout.data) {
+                std::cout << "  " << data_set.address;
+                for (auto const &value : data_set.values) {
+                    std::cout << " " << value.value << ' ' << value.unit;
+                }
+                std::cout << std::endl;
+            }
+        } catch (std::exception const& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    return 0;
+}
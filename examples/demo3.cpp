@@ -0,0 +1,64 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <ssp/discovery.h>
+#include <iostream>
+
+auto main(int argc, char *argv[]) -> int {
+
+    auto ports = std::vector<ssp::SerialInfo>{};
+    for (auto i = 1; i < argc; ++i) {
+        ports.push_back({argv[i]});
+    }
+    if (ports.empty()) {
+        ports = ssp::SerialPort::available_ports();
+    }
+
+    static char const *parity_names[] = {"N", "O", "E", "M", "S"};
+    static char const *stopbits_names[] = {"1", "1.5", "2"};
+
+    for (auto const &result : ssp::discover(ports)) {
+        std::cout << result.port.id << ": ";
+        if (result.error) {
+            try {
+                std::rethrow_exception(result.error);
+            } catch (std::exception const& e) {
+                std::cout << e.what();
+            }
+        } else if (result.found) {
+            auto const &config = result.config;
+            std::cout << static_cast<unsigned>(config.baud()) << ' '
+                      << 5 + static_cast<unsigned>(config.databits())
+                      << parity_names[static_cast<unsigned>(config.parity())]
+                      << stopbits_names[static_cast<unsigned>(config.stopbits())]
+                      << " (" << result.probe << ")";
+        } else {
+            std::cout << "no device";
+        }
+        std::cout << ", " << result.attempts << " probes in " << result.elapsed.count() << " ms" << std::endl;
+    }
+
+    return 0;
+}
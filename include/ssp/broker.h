@@ -0,0 +1,176 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_BROKER_H
+#define SIMPLE_SERIAL_PORT_BROKER_H
+
+#include <ssp/serial.h>
+#include <ssp/threading.h>
+#include <cstdint>
+
+namespace ssp
+{
+
+struct BrokerConsumerInfo
+{
+    unsigned slot;
+    long pid;
+    uint64_t lag_bytes;
+    uint64_t overruns;
+    uint64_t lost_bytes;
+    bool lagging;
+};
+
+/**
+ * Owns a serial port and shares it with other processes (linux only).
+ *
+ * Received data is published into a shared memory ring that any number of
+ * BrokerClient instances map read-only. The ring never waits for consumers:
+ * a consumer that falls more than one ring behind loses the oldest data and
+ * is reported through the lag listener. Data written by the clients goes
+ * through a shared memory queue and is transmitted by the broker. If the
+ * port hangs up or fails, the broker stops and its clients get
+ * SerialErrorNotOpen.
+ */
+class PortBroker
+{
+public:
+
+    /**
+     * Starts publishing a serial port
+     * @param port : serial port to be shared, must outlive the broker
+     * @param name : name of the broker (eg "/meter0"), stale objects with the same name are replaced
+     * @param rx_capacity : size in bytes of the receive ring, rounded up to a power of two
+     * @param tx_capacity : size in bytes of the transmit queue, rounded up to a power of two
+     * @param threads : placement of the receive and transmit threads
+     */
+    PortBroker(SerialPort &port,
+               std::string const &name,
+               size_t rx_capacity = 64 * 1024,
+               size_t tx_capacity = 16 * 1024,
+               ThreadOptions const &threads = ThreadOptions{});
+
+    ~PortBroker();
+
+    /**
+     * Installs a function called, from the broker thread, when a consumer falls behind
+     */
+    void install_lag_listener(std::function<void(BrokerConsumerInfo const&)> func);
+
+    /**
+     * Installs a function called, from the broker thread, when the port hangs up or fails
+     */
+    void install_closed_listener(std::function<void()> func);
+
+    /**
+     * Checks whether the broker is still serving the port
+     * @return false once the port has hung up or failed
+     */
+    auto alive() const -> bool;
+
+    /**
+     * Gets the state of the attached consumers
+     * @return vector with one entry per attached consumer
+     */
+    auto consumers() const -> std::vector<BrokerConsumerInfo>;
+
+    /**
+     * Gets how long the transmit thread took to wake up after clients queued data
+     * @return histogram of the wakeups since the broker started
+     */
+    auto wakeup_latency() const -> LatencyHistogram;
+
+    /**
+     * Gets the number of bytes dropped from the transmit queue because a
+     * client left inconsistent frame headers in it
+     * @return the number of bytes dropped
+     */
+    auto discarded_bytes() const -> uint64_t;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+/**
+ * Attaches to a port published by a PortBroker in another process
+ */
+class BrokerClient
+{
+public:
+
+    /**
+     * Attaches to a broker
+     * @param name : name given to the PortBroker
+     * @param timeout_ms : read and write timeout
+     */
+    explicit BrokerClient(std::string const &name, unsigned timeout_ms = 2000);
+
+    BrokerClient(BrokerClient &&rhs);
+
+    ~BrokerClient();
+
+    void set_timeout(unsigned timeout_ms);
+
+    /**
+     * Queues the contents of the data vector for transmission by the broker
+     * @param data : vector containing the data to be written
+     * @return the number of bytes queued
+     */
+    auto write(std::vector<uint8_t> const &data) -> size_t;
+
+    /**
+     * Get the number of available bytes for reading
+     * @return the number of available bytes
+     */
+    auto available() -> size_t;
+
+    /**
+     * Reads all data published since the last read, waiting up to the timeout for some
+     * @return the data read
+     */
+    auto read() -> std::vector<uint8_t>;
+
+    /**
+     * Appends all data published since the last read to the buffer, waiting up to the timeout for some
+     * @param buffer : vector where the data is appended
+     */
+    void read(std::vector<uint8_t> &buffer);
+
+    /**
+     * Gets the number of bytes this consumer lost by falling behind the broker
+     * @return the number of bytes lost
+     */
+    auto lost_bytes() const -> uint64_t;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_BROKER_H
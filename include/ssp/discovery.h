@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_DISCOVERY_H
+#define SIMPLE_SERIAL_PORT_DISCOVERY_H
+
+#include <ssp/serial.h>
+#include <ssp/threading.h>
+#include <cstdint>
+#include <chrono>
+
+namespace ssp
+{
+
+/**
+ * A request sent to find out if a device answers with the given settings
+ */
+struct DiscoveryProbe
+{
+    std::string name;
+    std::vector<uint8_t> request;
+
+    //true once the bytes received so far are a complete, valid reply
+    std::function<bool(std::vector<uint8_t> const&)> validate;
+
+    //settings where the probe makes sense, nullptr for all
+    std::function<bool(PortConfig const&)> accepts = nullptr;
+
+    unsigned response_timeout_ms = 100;
+
+    /**
+     * IEC 62056-21 sign-on, only tried at 300 7E1
+     */
+    static auto iec62056() -> DiscoveryProbe;
+
+    /**
+     * Modbus RTU read of one holding register, any reply with a valid CRC from the unit counts
+     * @param unit : unit identifier to query
+     */
+    static auto modbus_rtu(uint8_t unit = 1) -> DiscoveryProbe;
+};
+
+struct DiscoveryOptions
+{
+    std::vector<PortConfig> candidates;     //empty for the most common settings, most likely first, probed without flow control
+    std::vector<DiscoveryProbe> probes;     //empty for IEC 62056-21 and Modbus RTU unit 1
+    unsigned max_threads = 0;               //0 for one thread per port
+    unsigned inter_char_timeout_ms = 20;    //gap that ends a reply, never less than 5 character times
+    ThreadOptions threads;                  //placement of the probing threads
+};
+
+struct DiscoveryResult
+{
+    SerialInfo port;
+    bool found;
+    PortConfig config;
+    std::string probe;
+    std::vector<uint8_t> reply;
+    unsigned attempts;
+    std::chrono::milliseconds elapsed;
+    std::exception_ptr error;               //set when the port could not be used
+};
+
+/**
+ * Probes many ports concurrently for a device and its settings (linux only).
+ *
+ * Each port tries the candidate settings in order of likelihood: settings
+ * that already found a device on another port go first, and baud rates
+ * whose replies showed framing or parity errors go last. A port stops at
+ * the first valid reply.
+ *
+ * @param ports : ports to probe, usually SerialPort::available_ports()
+ * @param options : candidates, probes and timings
+ * @return one result per port, in the same order
+ */
+auto discover(std::vector<SerialInfo> const &ports,
+              DiscoveryOptions const &options = DiscoveryOptions{}) -> std::vector<DiscoveryResult>;
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_DISCOVERY_H
@@ -0,0 +1,183 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_IEC62056_H
+#define SIMPLE_SERIAL_PORT_IEC62056_H
+
+#include <ssp/serial.h>
+#include <ssp/threading.h>
+#include <cstdint>
+#include <exception>
+
+namespace ssp
+{
+
+struct Iec62056Value
+{
+    std::string value;
+    std::string unit;
+};
+
+/**
+ * One data set of a data readout, eg "1.8.0(001234.56*kWh)"
+ */
+struct Iec62056DataSet
+{
+    std::string address;
+    std::vector<Iec62056Value> values;
+};
+
+/**
+ * Identification message sent by the meter, eg "/ISK5\2MT382-1000"
+ */
+struct Iec62056Ident
+{
+    std::string manufacturer;
+    char baud_id;
+    Baudrate baudrate;
+    std::string identification;
+};
+
+struct Iec62056Readout
+{
+    Iec62056Ident ident;
+    Baudrate baudrate;
+    std::vector<Iec62056DataSet> data;
+};
+
+struct Iec62056Options
+{
+    Baudrate max_baudrate = Baudrate::_19200;  //highest rate accepted in the baud rate switch
+    unsigned reaction_time_ms = 200;           //delay between the end of the ident and the acknowledgement
+    unsigned response_timeout_ms = 1500;       //maximum delay before the meter starts answering
+    unsigned inter_char_timeout_ms = 1500;     //maximum gap between characters of a message
+};
+
+/**
+ * Incremental parser of a data readout message (STX data ! CR LF ETX BCC)
+ */
+class Iec62056Parser
+{
+public:
+
+    /**
+     * Creates a new parser
+     * @param on_data_set : function called for each data set as soon as it is complete
+     */
+    explicit Iec62056Parser(std::function<void(Iec62056DataSet const&)> on_data_set = nullptr);
+
+    /**
+     * Parses a chunk of the message
+     * @param data : pointer to the received bytes
+     * @param len : number of received bytes
+     * @return the number of bytes consumed, less than len only when the message is complete
+     */
+    auto feed(uint8_t const *data, size_t len) -> size_t;
+
+    /**
+     * Checks if the whole message, including a valid BCC, has been parsed
+     */
+    auto complete() const -> bool;
+
+    void reset();
+
+private:
+    enum class State { WAIT_STX, ADDRESS, VALUE, UNIT, AFTER_SET, END, BCC, DONE };
+
+    void emit();
+
+    std::function<void(Iec62056DataSet const&)> on_data_set_;
+    State state_;
+    uint8_t bcc_;
+    Iec62056DataSet current_;
+};
+
+/**
+ * IEC 62056-21 mode C client (linux only)
+ */
+class Iec62056Client
+{
+public:
+
+    /**
+     * Creates a new client
+     * @param port : serial port where the meter is connected, reconfigured by every read out
+     * @param options : protocol timings
+     */
+    explicit Iec62056Client(SerialPort &port, Iec62056Options const &options = Iec62056Options{});
+
+    /**
+     * Signs on, switches to the highest common baud rate and reads the data readout
+     * @param address : device address for multi-drop lines, empty for point to point
+     * @param on_data_set : optional function called for each data set as soon as it is received
+     * @return the identification and all the data sets
+     */
+    auto read_out(std::string const &address = "",
+                  std::function<void(Iec62056DataSet const&)> on_data_set = nullptr) -> Iec62056Readout;
+
+private:
+    SerialPort &port_;
+    Iec62056Options options_;
+};
+
+struct Iec62056Target
+{
+    std::string port;
+    std::string address;
+};
+
+struct Iec62056Result
+{
+    Iec62056Readout readout;
+    std::exception_ptr error;
+};
+
+/**
+ * Reads many meters concurrently, one thread per port, meters sharing a port are read in sequence
+ * @param targets : port and device address of each meter
+ * @param options : protocol timings
+ * @param threads : placement of the per port threads
+ * @return one result per target, in the same order
+ */
+auto iec62056_read_meters(std::vector<Iec62056Target> const &targets,
+                          Iec62056Options const &options = Iec62056Options{},
+                          ThreadOptions const &threads = ThreadOptions{}) -> std::vector<Iec62056Result>;
+
+struct Iec62056ErrorProtocol : public std::exception {
+    const char * what() const noexcept override {
+        return "malformed IEC 62056-21 message";
+    }
+};
+
+struct Iec62056ErrorBcc : public std::exception {
+    const char * what() const noexcept override {
+        return "IEC 62056-21 block check character mismatch";
+    }
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_IEC62056_H
@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_PACER_H
+#define SIMPLE_SERIAL_PORT_PACER_H
+
+#include <ssp/serial.h>
+#include <cstdint>
+
+namespace ssp
+{
+
+enum class Rs485Mode
+{
+    OFF,        //no direction control
+    KERNEL,     //driver controlled RTS (TIOCSRS485), fails if the driver lacks support
+    SOFTWARE,   //RTS toggled around each frame by the pacer
+    AUTO        //KERNEL when supported, SOFTWARE otherwise
+};
+
+struct Rs485Config
+{
+    Rs485Mode mode = Rs485Mode::OFF;
+    bool rts_on_send = true;                //RTS asserted while transmitting
+    bool rts_after_send = false;            //RTS asserted after transmitting
+    bool rx_during_tx = false;
+    unsigned delay_rts_before_send_ms = 0;
+    unsigned delay_rts_after_send_ms = 0;
+};
+
+enum class TxCompletion
+{
+    NONE,   //trust the computed frame duration
+    DRAIN,  //wait for the output queue to empty, then tcdrain
+    LSR     //poll the line status register until the transmitter is empty
+};
+
+struct PacerOptions
+{
+    unsigned inter_frame_gap_us = 0;    //idle time between frames, 0 for 3.5 character times
+    TxCompletion completion = TxCompletion::DRAIN;
+    Rs485Config rs485;
+};
+
+struct PacerStats
+{
+    uint64_t frames;
+    uint64_t late_frames;       //frames that waited for the gap but started more than a character time after it
+    double jitter_mean_us;      //mean delay between the end of the gap and the pacer waking up
+    double jitter_max_us;
+    double jitter_stddev_us;
+};
+
+/**
+ * Sends frames separated by exact inter-frame gaps (linux only).
+ *
+ * The end of each frame is taken from the completion wait, or computed
+ * from the baud rate and frame size, and the next frame is held until
+ * the gap after it has elapsed, using an absolute timerfd deadline.
+ */
+class TxPacer
+{
+public:
+
+    /**
+     * Creates a new pacer, configuring RS-485 mode if requested.
+     * RS-485 modes turn hardware flow control off until the pacer is destroyed.
+     * @param port : serial port used for transmission, must outlive the pacer
+     * @param options : gap, completion and direction control settings
+     */
+    explicit TxPacer(SerialPort &port, PacerOptions const &options = PacerOptions{});
+
+    TxPacer(TxPacer &&rhs);
+
+    ~TxPacer();
+
+    /**
+     * Waits for the inter-frame gap and writes a frame
+     * @param frame : vector containing the frame
+     * @return the number of bytes written
+     */
+    auto send(std::vector<uint8_t> const &frame) -> size_t;
+
+    /**
+     * Gets the time taken by one character with the current port settings
+     * @return the character time in nanoseconds
+     */
+    auto char_time_ns() const -> uint64_t;
+
+    auto stats() const -> PacerStats;
+
+    void reset_stats();
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_PACER_H
@@ -31,6 +31,7 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <cstdint>
 
 namespace ssp
 {
@@ -74,15 +75,104 @@ enum class Stopbits
     _2
 };
 
+enum class FlowControl
+{
+    NONE,       //3-wire lines, RS-485 and optical heads
+    RTS_CTS     //hardware handshake, output stops while CTS is low
+};
+
 struct SerialInfo
 {
     std::string id;
 };
 
+/**
+ * When a new configuration takes effect
+ */
+enum class ApplyMode
+{
+    NOW,    //immediately, data still in the output buffer is sent with the new settings
+    DRAIN   //after all queued output has been transmitted
+};
+
+/**
+ * Serial port settings, built with chained setters
+ * eg PortConfig{}.baud(Baudrate::_300).parity(Parity::EVEN).databits(Databits::_7)
+ */
+class PortConfig
+{
+public:
+    PortConfig() = default;
+
+    PortConfig(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms) :
+        baud_{baud}, parity_{par}, dbits_{dbits}, sbits_{sbits}, timeout_ms_{timeout_ms} {}
+
+    auto baud(Baudrate baud) -> PortConfig& { baud_ = baud; return *this; }
+    auto parity(Parity par) -> PortConfig& { parity_ = par; return *this; }
+    auto databits(Databits dbits) -> PortConfig& { dbits_ = dbits; return *this; }
+    auto stopbits(Stopbits sbits) -> PortConfig& { sbits_ = sbits; return *this; }
+    auto timeout(unsigned timeout_ms) -> PortConfig& { timeout_ms_ = timeout_ms; return *this; }
+    auto flow_control(FlowControl flow) -> PortConfig& { flow_ = flow; return *this; }
+
+    auto baud() const -> Baudrate { return baud_; }
+    auto parity() const -> Parity { return parity_; }
+    auto databits() const -> Databits { return dbits_; }
+    auto stopbits() const -> Stopbits { return sbits_; }
+    auto timeout() const -> unsigned { return timeout_ms_; }
+    auto flow_control() const -> FlowControl { return flow_; }
+
+    /**
+     * Checks if the line settings (everything but the timeout) are the same
+     */
+    auto same_line(PortConfig const &rhs) const -> bool
+    {
+        return baud_ == rhs.baud_ && parity_ == rhs.parity_ && dbits_ == rhs.dbits_ && sbits_ == rhs.sbits_ &&
+               flow_ == rhs.flow_;
+    }
+
+    /**
+     * Gets the time a character takes on the line: start, data, parity and stop bits
+     * @return the character time in nanoseconds
+     */
+    auto char_time_ns() const -> uint64_t
+    {
+        static unsigned const data_half_bits[] = {10, 12, 14, 16};
+        static unsigned const stop_half_bits[] = {2, 3, 4};
+        auto half_bits = 2 + data_half_bits[static_cast<unsigned>(dbits_)] +
+                         (parity_ != Parity::NONE ? 2 : 0) +
+                         stop_half_bits[static_cast<unsigned>(sbits_)];
+        return half_bits * 1000000000ull / (2ull * static_cast<unsigned>(baud_));
+    }
+
+    auto operator==(PortConfig const &rhs) const -> bool
+    {
+        return same_line(rhs) && timeout_ms_ == rhs.timeout_ms_;
+    }
+
+    auto operator!=(PortConfig const &rhs) const -> bool
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    Baudrate baud_ = Baudrate::_9600;
+    Parity parity_ = Parity::NONE;
+    Databits dbits_ = Databits::_8;
+    Stopbits sbits_ = Stopbits::_1;
+    unsigned timeout_ms_ = 2000;
+    FlowControl flow_ = FlowControl::RTS_CTS;
+};
+
 class SerialPort
 {
 public:
 
+#ifdef _WIN32
+    using native_handle_type = void*;
+#else
+    using native_handle_type = int;
+#endif
+
     /**
      * Gets the list of available ports
      * @return vector with list of ports identifiers
@@ -100,6 +190,13 @@ public:
                 Stopbits sbits = Stopbits::_1,
                 unsigned timeout_ms = 2000);
 
+    /**
+     * Creates a new serial port
+     * @param id : identifier of the serial port to be created (eg "COM1"in windows or "tty10"in linux)
+     * @param config : initial settings
+     */
+    SerialPort(std::string const &id, PortConfig const &config);
+
     SerialPort(SerialPort &&rhs);
 
     ~SerialPort();
@@ -127,6 +224,19 @@ public:
      */
     void set_params(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms);
 
+    /**
+     * Applies new settings, touching the device only for what differs from the current ones
+     * @param config : the new settings
+     * @param mode : whether to change immediately or after the pending output is sent
+     */
+    void apply(PortConfig const &config, ApplyMode mode = ApplyMode::NOW);
+
+    /**
+     * Gets the current settings
+     * @return the settings last applied
+     */
+    auto config() const -> PortConfig;
+
     /**
      * Writes the contents of the data vector into the serial port
      * @param data : vector containing the data to be written
@@ -159,6 +269,12 @@ public:
      */
     void read(std::vector<uint8_t> &buffer);
 
+    /**
+     * Gets the underlying OS handle (file descriptor in linux, HANDLE in windows)
+     * @return the native handle of the opened port
+     */
+    auto native_handle() const -> native_handle_type;
+
 private:
     class impl;
     std::unique_ptr<impl> pimpl_;
@@ -0,0 +1,127 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_THREADING_H
+#define SIMPLE_SERIAL_PORT_THREADING_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace ssp
+{
+
+/**
+ * Placement and scheduling of a thread started by the library
+ */
+struct ThreadOptions
+{
+    std::vector<unsigned> cpus;         //cpus the thread may run on, empty for any
+    int numa_node = -1;                 //keeps the thread and its allocations on a node, -1 for any
+    int priority = 0;                   //SCHED_FIFO priority from 1 to 99, 0 keeps the default scheduler
+    unsigned busy_poll_us = 0;          //time a waiting thread polls before going to sleep
+    size_t prefault_stack_bytes = 0;    //stack touched when the thread starts, at most the stack size less 64 KiB
+};
+
+/**
+ * Distribution of wakeup latencies, from the moment a thread was due to
+ * run until it ran
+ */
+struct LatencyHistogram
+{
+    static constexpr size_t buckets = 32;
+
+    //counts[i] holds the wakeups from 2^(i-1) up to 2^i ns, the last bucket everything longer
+    std::array<uint64_t, buckets> counts;
+    uint64_t samples;
+    uint64_t max_ns;
+
+    /**
+     * Gets an upper bound of a percentile
+     * @param percentile : 0 to 100
+     * @return the upper limit of the bucket holding the percentile, never more than max_ns
+     */
+    auto percentile_ns(double percentile) const -> uint64_t;
+};
+
+/**
+ * Collects wakeup latencies from one thread while others take snapshots
+ */
+class LatencyRecorder
+{
+public:
+    LatencyRecorder();
+
+    void record(uint64_t latency_ns);
+
+    auto snapshot() const -> LatencyHistogram;
+
+private:
+    std::array<std::atomic<uint64_t>, LatencyHistogram::buckets> counts_;
+    std::atomic<uint64_t> max_ns_;
+};
+
+/**
+ * Applies placement and scheduling options to the calling thread
+ * @param options : options to be applied, busy_poll_us is left to the waits of the thread
+ */
+void apply_thread_options(ThreadOptions const &options);
+
+/**
+ * Starts a thread with the given options applied before the body runs
+ * @param options : placement and scheduling of the new thread
+ * @param body : function run by the thread
+ * @return the running thread, SerialErrorThreadConfig is thrown and no thread is left if the options could not be applied
+ */
+auto start_thread(ThreadOptions const &options, std::function<void()> body) -> std::thread;
+
+/**
+ * Polls a condition for a bounded time
+ * @param window_us : how long to poll, 0 to check only once
+ * @param ready : condition to be polled
+ * @return true as soon as the condition holds, false when the window ends
+ */
+auto busy_poll(unsigned window_us, std::function<bool()> const &ready) -> bool;
+
+/**
+ * Locks the current and future pages of the process in memory, so that
+ * serial threads never wait for a page fault (linux only)
+ */
+void lock_memory();
+
+struct SerialErrorThreadConfig : public std::exception {
+    const char * what() const noexcept override {
+        return "error while configuring thread placement or scheduling";
+    }
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_THREADING_H
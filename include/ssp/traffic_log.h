@@ -0,0 +1,147 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_TRAFFIC_LOG_H
+#define SIMPLE_SERIAL_PORT_TRAFFIC_LOG_H
+
+#include <ssp/serial.h>
+#include <ssp/threading.h>
+#include <cstdint>
+
+namespace ssp
+{
+
+enum class TrafficDirection
+{
+    RX,
+    TX
+};
+
+/**
+ * Formats bytes as lowercase hex pairs separated by spaces, eg "2f 3f 21"
+ * @param data : bytes to be formatted
+ * @param len : number of bytes
+ * @param out : buffer with room for 3 * len characters
+ * @return the number of characters written, no terminator is added
+ */
+auto format_hex(uint8_t const *data, size_t len, char *out) -> size_t;
+
+/**
+ * Formats bytes as printable ASCII, non printable bytes become '.'
+ * @param data : bytes to be formatted
+ * @param len : number of bytes
+ * @param out : buffer with room for len characters
+ * @return the number of characters written, no terminator is added
+ */
+auto format_ascii(uint8_t const *data, size_t len, char *out) -> size_t;
+
+struct TrafficLoggerOptions
+{
+    std::string path;                   //file the log is appended to
+    size_t buffer_bytes = 1 << 20;      //capture buffer size, two are allocated
+    unsigned flush_interval_ms = 100;   //maximum time traffic waits before being written
+    bool ascii = true;                  //appends the ASCII column to each line
+    ThreadOptions thread;               //writer thread, it sleeps between batches so busy_poll_us is not used
+};
+
+/**
+ * Token bucket applied to the bytes logged for one port
+ */
+struct TrafficLimit
+{
+    uint64_t bytes_per_second = 0;      //0 for unlimited
+    uint64_t burst_bytes = 64 * 1024;
+};
+
+struct TrafficLoggerStats
+{
+    uint64_t events;
+    uint64_t bytes;
+    uint64_t rate_limited;      //events dropped by the port limits
+    uint64_t overflows;         //records dropped because the writer fell behind, rate limit summaries are retried
+    uint64_t file_writes;
+    uint64_t write_errors;      //file writes that failed or were cut short, eg disk full
+    LatencyHistogram wakeup_latency;    //from a flush being due until the writer ran
+};
+
+/**
+ * Logs the traffic seen by rx/tx listeners to a file.
+ *
+ * Listeners only copy the raw bytes into a preallocated capture buffer.
+ * A background thread swaps buffers, formats the whole batch into one
+ * text buffer and writes it with a single call.
+ *
+ * eg "2018-06-01T10:00:00.000123Z meter0 TX 5: 2f 3f 21 0d 0a |/?!..|"
+ */
+class TrafficLogger
+{
+public:
+
+    /**
+     * Opens the log file and starts the writer thread
+     * @param options : file, buffering and format
+     */
+    explicit TrafficLogger(TrafficLoggerOptions const &options);
+
+    /**
+     * Writes everything captured so far and stops the writer thread
+     */
+    ~TrafficLogger();
+
+    /**
+     * Creates a listener that logs to this logger
+     * @param name : name written in each line
+     * @param direction : direction written in each line
+     * @param limit : rate limit of this listener
+     * @return a function suitable for install_rx_listener/install_tx_listener
+     */
+    auto tap(std::string const &name,
+             TrafficDirection direction,
+             TrafficLimit const &limit = TrafficLimit{}) -> std::function<void(const std::vector<uint8_t>&)>;
+
+    /**
+     * Installs rx and tx listeners in a port, replacing the current ones
+     * @param port : port to be logged
+     * @param name : name written in each line
+     * @param limit : rate limit shared by both directions
+     */
+    void attach(SerialPort &port, std::string const &name, TrafficLimit const &limit = TrafficLimit{});
+
+    /**
+     * Waits until everything captured so far is written
+     */
+    void flush();
+
+    auto stats() const -> TrafficLoggerStats;
+
+private:
+    class impl;
+    std::shared_ptr<impl> pimpl_;
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_TRAFFIC_LOG_H
@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#ifndef SIMPLE_SERIAL_PORT_TX_QUEUE_H
+#define SIMPLE_SERIAL_PORT_TX_QUEUE_H
+
+#include <ssp/serial.h>
+#include <ssp/threading.h>
+#include <cstdint>
+#include <exception>
+#include <future>
+
+namespace ssp
+{
+
+/**
+ * What submit does when the queue is full
+ */
+enum class Backpressure
+{
+    BLOCK,  //waits for room
+    REJECT  //fails the frame immediately
+};
+
+struct TxQueueOptions
+{
+    size_t max_frames = 1024;           //queue bound
+    size_t max_batch_bytes = 4096;      //bytes handed to a single writev
+    unsigned max_batch_delay_us = 0;    //how long the oldest frame may wait for others to coalesce with
+    Backpressure backpressure = Backpressure::BLOCK;
+    ThreadOptions thread;               //transmit thread, busy_poll_us keeps it polling for frames before sleeping
+};
+
+struct TxQueueStats
+{
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t writes;            //writev calls
+    uint64_t partial_writes;    //writev calls that did not take the whole batch
+    uint64_t rejected;
+    LatencyHistogram wakeup_latency;    //from a frame queued to the idle thread until the thread picked it up
+};
+
+/**
+ * Transmits frames from a background thread (linux only).
+ *
+ * Frames queued by any thread are coalesced into writev calls of up to
+ * max_batch_bytes. Each frame completes, through its callback or future,
+ * once its last byte has been handed to the driver.
+ */
+class TxQueue
+{
+public:
+
+    /**
+     * Starts the transmit thread
+     * @param port : serial port used for transmission, must outlive the queue
+     * @param options : bound, backpressure and coalescing budget
+     */
+    explicit TxQueue(SerialPort &port, TxQueueOptions const &options = TxQueueOptions{});
+
+    /**
+     * Transmits the frames still queued and stops the thread
+     */
+    ~TxQueue();
+
+    /**
+     * Queues a frame
+     * @param frame : the frame to be written
+     * @param on_complete : called from the transmit thread with nullptr on success or the error
+     * @return false if the queue was full and the backpressure is REJECT
+     */
+    auto submit(std::vector<uint8_t> frame,
+                std::function<void(std::exception_ptr)> on_complete = nullptr) -> bool;
+
+    /**
+     * Queues a frame
+     * @param frame : the frame to be written
+     * @return a future that becomes ready when the frame is written, holding
+     *         SerialErrorQueueFull if it was rejected or SerialErrorIO if writing failed
+     */
+    auto submit_future(std::vector<uint8_t> frame) -> std::future<void>;
+
+    /**
+     * Waits until every queued frame is written
+     */
+    void flush();
+
+    void install_tx_listener(std::function<void(const std::vector<uint8_t>&)> func);
+
+    auto stats() const -> TxQueueStats;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+struct SerialErrorQueueFull : public std::exception {
+    const char * what() const noexcept override {
+        return "serial transmit queue is full";
+    }
+};
+
+}
+
+#endif //SIMPLE_SERIAL_PORT_TX_QUEUE_H
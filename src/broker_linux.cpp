@@ -0,0 +1,902 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/broker.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <algorithm>
+
+namespace ssp
+{
+    namespace {
+
+        constexpr uint32_t broker_magic = 0x42505353; //"SSPB"
+        constexpr uint32_t broker_version = 3;
+        constexpr unsigned max_consumers = 32;
+        constexpr size_t min_capacity = 4096;
+
+        enum SlotState : uint32_t {
+            SLOT_FREE = 0,
+            SLOT_CLAIMING = 1,
+            SLOT_ATTACHED = 2
+        };
+
+        //receive ring header, mapped read-only by the clients
+        struct RxHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t capacity;
+            alignas(64) std::atomic<uint64_t> reserve_seq; //end of the region being overwritten
+            alignas(64) std::atomic<uint64_t> write_seq;   //end of the published data
+        };
+
+        //a slot belongs to whoever holds the OFD lock on its first byte of the
+        //control object, the pid is only reported
+        struct alignas(64) ConsumerSlot {
+            std::atomic<uint32_t> state;
+            std::atomic<uint32_t> lagging;
+            std::atomic<int32_t> pid;
+            std::atomic<uint64_t> read_seq;
+            std::atomic<uint64_t> overruns;
+            std::atomic<uint64_t> lost_bytes;
+        };
+
+        //control block, mapped read-write by everyone
+        struct CtlHeader {
+            std::atomic<uint32_t> magic;
+            uint32_t version;
+            uint64_t rx_capacity;
+            uint64_t tx_capacity;
+            std::atomic<uint32_t> owner_alive;
+            alignas(64) std::atomic<uint32_t> rx_doorbell;
+            std::atomic<uint32_t> rx_waiters;
+            alignas(64) std::atomic<uint32_t> tx_doorbell;
+            std::atomic<uint64_t> tx_rung_ns; //earliest ring not yet seen by the broker, 0 for none
+            std::atomic<uint32_t> tx_space;
+            std::atomic<uint32_t> tx_space_waiters;
+            pthread_mutex_t tx_lock;
+            uint64_t tx_head;
+            uint64_t tx_tail;
+            ConsumerSlot slots[max_consumers];
+        };
+
+        static_assert(ATOMIC_INT_LOCK_FREE == 2, "futex words must be lock free");
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "ring sequences must be lock free");
+
+        struct Mapping {
+            void *addr = MAP_FAILED;
+            size_t len = 0;
+            int fd = -1;    //kept open only when it carries slot locks
+
+            Mapping() = default;
+            Mapping(Mapping const&) = delete;
+            Mapping& operator=(Mapping const&) = delete;
+
+            ~Mapping()
+            {
+                if (addr != MAP_FAILED) {
+                    munmap(addr, len);
+                }
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+        };
+
+        auto futex_word(std::atomic<uint32_t> *word) -> uint32_t*
+        {
+            return reinterpret_cast<uint32_t*>(word);
+        }
+
+        void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, long timeout_ms = -1)
+        {
+            struct timespec ts;
+            struct timespec *pts = nullptr;
+            if (timeout_ms >= 0) {
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+                pts = &ts;
+            }
+            syscall(SYS_futex, futex_word(word), FUTEX_WAIT, expected, pts, nullptr, 0);
+        }
+
+        void futex_wake(std::atomic<uint32_t> *word, int count = INT_MAX)
+        {
+            syscall(SYS_futex, futex_word(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+        }
+
+        //monotonic clock, comparable between processes
+        auto now_ns() -> uint64_t
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        auto round_pow2(size_t value) -> size_t
+        {
+            size_t retval = min_capacity;
+            while (retval < value) {
+                retval <<= 1;
+            }
+            return retval;
+        }
+
+        void ring_write(uint8_t *ring, uint64_t mask, uint64_t pos, uint8_t const *src, size_t len)
+        {
+            auto offset = pos & mask;
+            auto first = std::min<uint64_t>(len, mask + 1 - offset);
+            memcpy(ring + offset, src, first);
+            memcpy(ring, src + first, len - first);
+        }
+
+        void ring_read(uint8_t const *ring, uint64_t mask, uint64_t pos, uint8_t *dst, size_t len)
+        {
+            auto offset = pos & mask;
+            auto first = std::min<uint64_t>(len, mask + 1 - offset);
+            memcpy(dst, ring + offset, first);
+            memcpy(dst + first, ring, len - first);
+        }
+
+        void lock_tx(CtlHeader *ctl)
+        {
+            auto res = pthread_mutex_lock(&ctl->tx_lock);
+            if (res == EOWNERDEAD) {
+                //the queue indexes are only moved after the payload is complete,
+                //so a client dying while holding the lock leaves it consistent
+                pthread_mutex_consistent(&ctl->tx_lock);
+            } else if (res != 0) {
+                throw SerialErrorIO();
+            }
+        }
+
+        void map_shared(Mapping &mapping, std::string const &name, size_t len, bool create, bool writable, bool keep_open = false)
+        {
+            int fd;
+            if (create) {
+                shm_unlink(name.c_str());
+                fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+                if (fd >= 0 && ftruncate(fd, len) < 0) {
+                    close(fd);
+                    fd = -1;
+                }
+            } else {
+                fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+                struct stat st;
+                if (fd >= 0 && (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < len)) {
+                    close(fd);
+                    fd = -1;
+                }
+                if (fd >= 0) {
+                    len = st.st_size;
+                }
+            }
+            if (fd < 0) {
+                throw SerialErrorOpening();
+            }
+
+            mapping.addr = mmap(nullptr, len, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            mapping.len = len;
+            if (keep_open) {
+                mapping.fd = fd;
+            } else {
+                close(fd);
+            }
+            if (mapping.addr == MAP_FAILED) {
+                throw SerialErrorOpening();
+            }
+        }
+
+        /**
+         * Takes or releases the lock on a consumer slot. OFD locks belong to the
+         * open file description rather than the process, so they hold across pid
+         * namespaces, between clients of the same process, and go away with the
+         * client however it dies
+         * @return false if another description holds the slot
+         */
+        auto lock_slot(Mapping const &ctl_map, unsigned index, short type) -> bool
+        {
+            auto ctl = static_cast<CtlHeader*>(ctl_map.addr);
+            struct flock fl = {};
+            fl.l_type = type;
+            fl.l_whence = SEEK_SET;
+            fl.l_start = reinterpret_cast<char*>(&ctl->slots[index]) - reinterpret_cast<char*>(ctl);
+            fl.l_len = 1;
+            return fcntl(ctl_map.fd, F_OFD_SETLK, &fl) == 0;
+        }
+
+        auto consumer_info(ConsumerSlot const &slot, unsigned index, uint64_t write_seq) -> BrokerConsumerInfo
+        {
+            BrokerConsumerInfo info;
+            info.slot = index;
+            info.pid = slot.pid.load(std::memory_order_relaxed);
+            info.lag_bytes = write_seq - slot.read_seq.load(std::memory_order_relaxed);
+            info.overruns = slot.overruns.load(std::memory_order_relaxed);
+            info.lost_bytes = slot.lost_bytes.load(std::memory_order_relaxed);
+            info.lagging = slot.lagging.load(std::memory_order_relaxed) != 0;
+            return info;
+        }
+    }
+
+    class PortBroker::impl {
+
+        int fd_;
+        int stop_fd_;
+        std::string rx_name_;
+        std::string ctl_name_;
+        Mapping rx_map_;
+        Mapping ctl_map_;
+        RxHeader *rx_;
+        CtlHeader *ctl_;
+        uint8_t *rx_data_;
+        uint8_t *tx_data_;
+        uint64_t rx_mask_;
+        uint64_t tx_mask_;
+        std::atomic<bool> running_{true};
+        std::mutex listener_mutex_;
+        std::function<void(BrokerConsumerInfo const&)> lag_listener_ = nullptr;
+        std::function<void()> closed_listener_ = nullptr;
+        std::atomic<bool> lost_{false};
+        ThreadOptions threads_;
+        LatencyRecorder wakeups_;
+        std::atomic<uint64_t> discarded_bytes_{0};
+        std::thread rx_thread_;
+        std::thread tx_thread_;
+
+    public:
+        impl(SerialPort &port, std::string const &name, size_t rx_capacity, size_t tx_capacity, ThreadOptions const &threads) :
+            fd_{port.native_handle()},
+            rx_name_{name + ".rx"},
+            ctl_name_{name + ".ctl"},
+            threads_{threads}
+        {
+            rx_capacity = round_pow2(rx_capacity);
+            tx_capacity = round_pow2(tx_capacity);
+
+            try {
+                map_shared(rx_map_, rx_name_, sizeof(RxHeader) + rx_capacity, true, true);
+                map_shared(ctl_map_, ctl_name_, sizeof(CtlHeader) + tx_capacity, true, true, true);
+            } catch (SerialErrorOpening const&) {
+                unlink();
+                throw;
+            }
+
+            rx_ = new (rx_map_.addr) RxHeader{};
+            rx_->capacity = rx_capacity;
+            rx_->version = broker_version;
+            rx_data_ = static_cast<uint8_t*>(rx_map_.addr) + sizeof(RxHeader);
+            rx_mask_ = rx_capacity - 1;
+
+            ctl_ = new (ctl_map_.addr) CtlHeader{};
+            ctl_->version = broker_version;
+            ctl_->rx_capacity = rx_capacity;
+            ctl_->tx_capacity = tx_capacity;
+            tx_data_ = static_cast<uint8_t*>(ctl_map_.addr) + sizeof(CtlHeader);
+            tx_mask_ = tx_capacity - 1;
+
+            //fault the rings in now rather than on the first traffic
+            memset(rx_data_, 0, rx_capacity);
+            memset(tx_data_, 0, tx_capacity);
+
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+            auto res = pthread_mutex_init(&ctl_->tx_lock, &attr);
+            pthread_mutexattr_destroy(&attr);
+            if (res != 0) {
+                unlink();
+                throw SerialErrorOpening();
+            }
+
+            if ((stop_fd_ = eventfd(0, EFD_CLOEXEC)) < 0) {
+                unlink();
+                throw SerialErrorOpening();
+            }
+
+            //set before the threads run, a port already hung up clears it again
+            ctl_->owner_alive.store(1);
+
+            try {
+                rx_thread_ = start_thread(threads, [this] { rx_loop(); });
+                tx_thread_ = start_thread(threads, [this] { tx_loop(); });
+            } catch (...) {
+                stop_threads();
+                close(stop_fd_);
+                unlink();
+                throw;
+            }
+
+            rx_->magic = broker_magic;
+            ctl_->magic.store(broker_magic, std::memory_order_release);
+        }
+
+        ~impl()
+        {
+            stop_threads();
+            close(stop_fd_);
+            notify_closed();
+            unlink();
+        }
+
+        void install_lag_listener(std::function<void(BrokerConsumerInfo const&)> func)
+        {
+            std::lock_guard<std::mutex> lock(listener_mutex_);
+            lag_listener_ = func;
+        }
+
+        void install_closed_listener(std::function<void()> func)
+        {
+            std::lock_guard<std::mutex> lock(listener_mutex_);
+            closed_listener_ = func;
+        }
+
+        auto alive() const -> bool
+        {
+            return ctl_->owner_alive.load() != 0;
+        }
+
+        auto consumers() const -> std::vector<BrokerConsumerInfo>
+        {
+            std::vector<BrokerConsumerInfo> retval;
+            auto write_seq = rx_->write_seq.load(std::memory_order_acquire);
+            for (unsigned i = 0; i < max_consumers; ++i) {
+                if (ctl_->slots[i].state.load() == SLOT_ATTACHED) {
+                    retval.push_back(consumer_info(ctl_->slots[i], i, write_seq));
+                }
+            }
+            return retval;
+        }
+
+        auto wakeup_latency() const -> LatencyHistogram
+        {
+            return wakeups_.snapshot();
+        }
+
+        auto discarded_bytes() const -> uint64_t
+        {
+            return discarded_bytes_.load();
+        }
+
+    private:
+        void request_stop()
+        {
+            running_.store(false);
+            uint64_t one = 1;
+            (void)::write(stop_fd_, &one, sizeof(one));
+            ctl_->tx_doorbell.fetch_add(1);
+            futex_wake(&ctl_->tx_doorbell);
+        }
+
+        void stop_threads()
+        {
+            request_stop();
+            if (rx_thread_.joinable()) {
+                rx_thread_.join();
+            }
+            if (tx_thread_.joinable()) {
+                tx_thread_.join();
+            }
+        }
+
+        //wakes every waiting client so that it sees the broker is gone
+        void notify_closed()
+        {
+            ctl_->owner_alive.store(0);
+            ctl_->rx_doorbell.fetch_add(1);
+            futex_wake(&ctl_->rx_doorbell);
+            ctl_->tx_space.fetch_add(1);
+            futex_wake(&ctl_->tx_space);
+        }
+
+        //called from the broker threads when the port hangs up or fails
+        void port_lost()
+        {
+            //both threads may see the failure, the owner hears about it once
+            if (lost_.exchange(true)) {
+                return;
+            }
+            request_stop();
+            notify_closed();
+
+            std::lock_guard<std::mutex> lock(listener_mutex_);
+            if (closed_listener_ != nullptr) {
+                closed_listener_();
+            }
+        }
+
+        void unlink()
+        {
+            shm_unlink(rx_name_.c_str());
+            shm_unlink(ctl_name_.c_str());
+        }
+
+        void rx_loop()
+        {
+            std::vector<uint8_t> buffer(min_capacity);
+            struct pollfd fds[2] = {{fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+            auto last_sweep = std::chrono::steady_clock::now();
+
+            while (running_.load(std::memory_order_relaxed)) {
+                auto res = 0;
+                if (threads_.busy_poll_us != 0) {
+                    busy_poll(threads_.busy_poll_us, [&] {
+                        res = poll(fds, 2, 0);
+                        return res != 0;
+                    });
+                }
+                if (res == 0) {
+                    res = poll(fds, 2, 1000);
+                }
+                if (res < 0 && errno != EINTR) {
+                    port_lost();
+                    break;
+                }
+                if (res < 0 || fds[1].revents != 0) {
+                    continue;
+                }
+                if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    port_lost();
+                    break;
+                }
+                if (fds[0].revents & POLLIN) {
+                    auto n = ::read(fd_, buffer.data(), buffer.size());
+                    if (n > 0) {
+                        publish(buffer.data(), static_cast<size_t>(n));
+                    } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                        port_lost();
+                        break;
+                    }
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_sweep > std::chrono::seconds(1)) {
+                    sweep_consumers();
+                    last_sweep = now;
+                }
+            }
+        }
+
+        void publish(uint8_t const *data, size_t len)
+        {
+            auto write_seq = rx_->write_seq.load(std::memory_order_relaxed);
+
+            //announce the region about to be overwritten before touching it, so
+            //readers copying concurrently can discard what they might have torn
+            rx_->reserve_seq.store(write_seq + len, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            ring_write(rx_data_, rx_mask_, write_seq, data, len);
+            rx_->write_seq.store(write_seq + len, std::memory_order_release);
+
+            ctl_->rx_doorbell.fetch_add(1);
+            if (ctl_->rx_waiters.load() != 0) {
+                futex_wake(&ctl_->rx_doorbell);
+            }
+
+            check_lag(write_seq + len);
+        }
+
+        void check_lag(uint64_t write_seq)
+        {
+            for (unsigned i = 0; i < max_consumers; ++i) {
+                auto &slot = ctl_->slots[i];
+                if (slot.state.load(std::memory_order_relaxed) != SLOT_ATTACHED) {
+                    continue;
+                }
+                auto lag = write_seq - slot.read_seq.load(std::memory_order_relaxed);
+                if (lag > rx_->capacity && slot.lagging.exchange(1) == 0) {
+                    std::lock_guard<std::mutex> lock(listener_mutex_);
+                    if (lag_listener_ != nullptr) {
+                        lag_listener_(consumer_info(slot, i, write_seq));
+                    }
+                }
+            }
+        }
+
+        //frees the slots whose client is gone, attached or halfway through claiming
+        void sweep_consumers()
+        {
+            for (unsigned i = 0; i < max_consumers; ++i) {
+                auto &slot = ctl_->slots[i];
+                if (slot.state.load() == SLOT_FREE || !lock_slot(ctl_map_, i, F_WRLCK)) {
+                    continue;
+                }
+                slot.state.store(SLOT_FREE);
+                lock_slot(ctl_map_, i, F_UNLCK);
+            }
+        }
+
+        void tx_loop()
+        {
+            std::vector<uint8_t> batch;
+            auto waited = false;
+            while (running_.load(std::memory_order_relaxed)) {
+                auto woke_ns = now_ns();
+                auto doorbell = ctl_->tx_doorbell.load();
+                batch.clear();
+                try {
+                    drain(batch);
+                } catch (SerialErrorIO const&) {
+                    break;
+                }
+
+                //only rings that found the thread waiting measure a wakeup
+                auto rung_ns = ctl_->tx_rung_ns.exchange(0);
+                if (waited && rung_ns != 0 && woke_ns >= rung_ns) {
+                    wakeups_.record(woke_ns - rung_ns);
+                }
+                waited = false;
+
+                if (batch.empty()) {
+                    auto rung = busy_poll(threads_.busy_poll_us, [&] {
+                        return ctl_->tx_doorbell.load(std::memory_order_acquire) != doorbell;
+                    });
+                    if (!rung) {
+                        futex_wait(&ctl_->tx_doorbell, doorbell);
+                    }
+                    waited = true;
+                    continue;
+                }
+                if (!write_all(batch)) {
+                    port_lost();
+                    break;
+                }
+            }
+        }
+
+        void drain(std::vector<uint8_t> &batch)
+        {
+            lock_tx(ctl_);
+            auto pos = ctl_->tx_tail;
+            auto head = ctl_->tx_head;
+            if (head - pos > tx_mask_ + 1) {
+                discard(pos, head);
+                pos = head;
+            }
+            while (pos != head) {
+                //the queue is writable by every client, nothing in it is trusted
+                uint32_t len;
+                if (head - pos < sizeof(len)) {
+                    discard(pos, head);
+                    break;
+                }
+                ring_read(tx_data_, tx_mask_, pos, reinterpret_cast<uint8_t*>(&len), sizeof(len));
+                if (len > head - pos - sizeof(len)) {
+                    discard(pos, head);
+                    break;
+                }
+                pos += sizeof(len);
+                auto offset = batch.size();
+                batch.resize(offset + len);
+                ring_read(tx_data_, tx_mask_, pos, batch.data() + offset, len);
+                pos += len;
+            }
+            auto freed = head != ctl_->tx_tail;
+            ctl_->tx_tail = head;
+            pthread_mutex_unlock(&ctl_->tx_lock);
+
+            if (freed) {
+                ctl_->tx_space.fetch_add(1);
+                if (ctl_->tx_space_waiters.load() != 0) {
+                    futex_wake(&ctl_->tx_space);
+                }
+            }
+        }
+
+        //called with tx_lock held
+        void discard(uint64_t pos, uint64_t head)
+        {
+            discarded_bytes_ += head - pos;
+        }
+
+        auto write_all(std::vector<uint8_t> const &batch) -> bool
+        {
+            size_t offset = 0;
+            while (offset < batch.size()) {
+                auto res = ::write(fd_, batch.data() + offset, batch.size() - offset);
+                if (res > 0) {
+                    offset += static_cast<size_t>(res);
+                } else if (res < 0 && errno == EAGAIN) {
+                    struct pollfd pfd = {fd_, POLLOUT, 0};
+                    poll(&pfd, 1, 100);
+                } else if (res < 0 && errno != EINTR) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    class BrokerClient::impl {
+
+        Mapping rx_map_;
+        Mapping ctl_map_;
+        RxHeader const *rx_;
+        CtlHeader *ctl_;
+        ConsumerSlot *slot_ = nullptr;
+        uint8_t const *rx_data_;
+        uint8_t *tx_data_;
+        uint64_t rx_mask_;
+        uint64_t tx_mask_;
+        unsigned timeout_ms_;
+
+    public:
+        impl(std::string const &name, unsigned timeout_ms) : timeout_ms_{timeout_ms}
+        {
+            map_shared(ctl_map_, name + ".ctl", sizeof(CtlHeader), false, true, true);
+            ctl_ = static_cast<CtlHeader*>(ctl_map_.addr);
+            if (ctl_->magic.load(std::memory_order_acquire) != broker_magic || ctl_->version != broker_version) {
+                throw SerialErrorOpening();
+            }
+
+            map_shared(rx_map_, name + ".rx", sizeof(RxHeader) + ctl_->rx_capacity, false, false);
+            rx_ = static_cast<RxHeader const*>(rx_map_.addr);
+            if (rx_->magic != broker_magic || rx_->capacity != ctl_->rx_capacity) {
+                throw SerialErrorOpening();
+            }
+
+            rx_data_ = static_cast<uint8_t const*>(rx_map_.addr) + sizeof(RxHeader);
+            rx_mask_ = ctl_->rx_capacity - 1;
+            tx_data_ = static_cast<uint8_t*>(ctl_map_.addr) + sizeof(CtlHeader);
+            tx_mask_ = ctl_->tx_capacity - 1;
+
+            //the lock is held until the mapping closes, a slot whose owner died
+            //before releasing it is free to take whatever its state says
+            for (unsigned i = 0; i < max_consumers; ++i) {
+                if (!lock_slot(ctl_map_, i, F_WRLCK)) {
+                    continue;
+                }
+                auto &slot = ctl_->slots[i];
+                slot.state.store(SLOT_CLAIMING);
+                slot.pid.store(getpid());
+                slot.overruns.store(0);
+                slot.lost_bytes.store(0);
+                slot.lagging.store(0);
+                slot.read_seq.store(rx_->write_seq.load(std::memory_order_acquire));
+                slot.state.store(SLOT_ATTACHED);
+                slot_ = &slot;
+                break;
+            }
+            if (slot_ == nullptr) {
+                throw SerialErrorOpening();
+            }
+        }
+
+        ~impl()
+        {
+            slot_->state.store(SLOT_FREE);
+        }
+
+        void set_timeout(unsigned timeout_ms)
+        {
+            timeout_ms_ = timeout_ms;
+        }
+
+        auto write(std::vector<uint8_t> const &data) -> size_t
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_);
+            auto max_chunk = ctl_->tx_capacity - sizeof(uint32_t);
+            size_t offset = 0;
+            while (offset < data.size()) {
+                auto len = std::min<size_t>(data.size() - offset, max_chunk);
+                enqueue(data.data() + offset, len, deadline);
+                offset += len;
+            }
+            return offset;
+        }
+
+        auto available() -> size_t
+        {
+            auto lag = rx_->write_seq.load(std::memory_order_acquire) - slot_->read_seq.load(std::memory_order_relaxed);
+            return static_cast<size_t>(std::min<uint64_t>(lag, rx_->capacity));
+        }
+
+        auto read() -> std::vector<uint8_t>
+        {
+            std::vector<uint8_t> retval;
+            read(retval);
+            return retval;
+        }
+
+        void read(std::vector<uint8_t> &buffer)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_);
+            while (!consume(buffer)) {
+                if (ctl_->owner_alive.load() == 0) {
+                    throw SerialErrorNotOpen();
+                }
+
+                auto doorbell = ctl_->rx_doorbell.load();
+                ctl_->rx_waiters.fetch_add(1);
+                if (rx_->write_seq.load() != slot_->read_seq.load(std::memory_order_relaxed)) {
+                    ctl_->rx_waiters.fetch_sub(1);
+                    continue;
+                }
+
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining <= 0) {
+                    ctl_->rx_waiters.fetch_sub(1);
+                    throw SerialErrorTimeout();
+                }
+                futex_wait(&ctl_->rx_doorbell, doorbell, remaining);
+                ctl_->rx_waiters.fetch_sub(1);
+            }
+        }
+
+        auto lost_bytes() const -> uint64_t
+        {
+            return slot_->lost_bytes.load(std::memory_order_relaxed);
+        }
+
+    private:
+        auto consume(std::vector<uint8_t> &buffer) -> bool
+        {
+            auto capacity = rx_->capacity;
+            auto read_seq = slot_->read_seq.load(std::memory_order_relaxed);
+            auto write_seq = rx_->write_seq.load(std::memory_order_acquire);
+            if (write_seq == read_seq) {
+                return false;
+            }
+
+            auto from = write_seq - read_seq > capacity ? write_seq - capacity : read_seq;
+            auto initial_size = buffer.size();
+            buffer.resize(initial_size + (write_seq - from));
+            ring_read(rx_data_, rx_mask_, from, buffer.data() + initial_size, write_seq - from);
+
+            //anything the broker started overwriting during the copy is unreliable
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto reserve_seq = rx_->reserve_seq.load(std::memory_order_relaxed);
+            if (reserve_seq > capacity && reserve_seq - capacity > from) {
+                auto torn = std::min(reserve_seq - capacity, write_seq) - from;
+                buffer.erase(buffer.begin() + initial_size, buffer.begin() + initial_size + torn);
+                from += torn;
+            }
+
+            if (from != read_seq) {
+                slot_->overruns.fetch_add(1, std::memory_order_relaxed);
+                slot_->lost_bytes.fetch_add(from - read_seq, std::memory_order_relaxed);
+            }
+            slot_->read_seq.store(write_seq, std::memory_order_release);
+            slot_->lagging.store(0, std::memory_order_relaxed);
+            return buffer.size() != initial_size;
+        }
+
+        void enqueue(uint8_t const *data, size_t len, std::chrono::steady_clock::time_point deadline)
+        {
+            auto needed = sizeof(uint32_t) + len;
+            while (true) {
+                if (ctl_->owner_alive.load() == 0) {
+                    throw SerialErrorNotOpen();
+                }
+                auto space = ctl_->tx_space.load();
+
+                lock_tx(ctl_);
+                if (ctl_->tx_capacity - (ctl_->tx_head - ctl_->tx_tail) >= needed) {
+                    auto len32 = static_cast<uint32_t>(len);
+                    ring_write(tx_data_, tx_mask_, ctl_->tx_head, reinterpret_cast<uint8_t const*>(&len32), sizeof(len32));
+                    ring_write(tx_data_, tx_mask_, ctl_->tx_head + sizeof(len32), data, len);
+                    ctl_->tx_head += needed;
+                    pthread_mutex_unlock(&ctl_->tx_lock);
+
+                    uint64_t none = 0;
+                    ctl_->tx_rung_ns.compare_exchange_strong(none, now_ns());
+                    ctl_->tx_doorbell.fetch_add(1);
+                    futex_wake(&ctl_->tx_doorbell, 1);
+                    return;
+                }
+                pthread_mutex_unlock(&ctl_->tx_lock);
+
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining <= 0) {
+                    throw SerialErrorTimeout();
+                }
+                ctl_->tx_space_waiters.fetch_add(1);
+                futex_wait(&ctl_->tx_space, space, remaining);
+                ctl_->tx_space_waiters.fetch_sub(1);
+            }
+        }
+    };
+
+    PortBroker::PortBroker(SerialPort &port,
+                           std::string const &name,
+                           size_t rx_capacity,
+                           size_t tx_capacity,
+                           ThreadOptions const &threads) :
+        pimpl_{std::make_unique<impl>(port, name, rx_capacity, tx_capacity, threads)} {};
+
+    PortBroker::~PortBroker() = default;
+
+    void PortBroker::install_lag_listener(std::function<void(BrokerConsumerInfo const&)> func) {
+        pimpl_->install_lag_listener(func);
+    }
+
+    void PortBroker::install_closed_listener(std::function<void()> func) {
+        pimpl_->install_closed_listener(func);
+    }
+
+    auto PortBroker::alive() const -> bool {
+        return pimpl_->alive();
+    }
+
+    auto PortBroker::consumers() const -> std::vector<BrokerConsumerInfo> {
+        return pimpl_->consumers();
+    }
+
+    auto PortBroker::wakeup_latency() const -> LatencyHistogram {
+        return pimpl_->wakeup_latency();
+    }
+
+    auto PortBroker::discarded_bytes() const -> uint64_t {
+        return pimpl_->discarded_bytes();
+    }
+
+    BrokerClient::BrokerClient(std::string const &name, unsigned timeout_ms) :
+        pimpl_{std::make_unique<impl>(name, timeout_ms)} {};
+
+    BrokerClient::BrokerClient(BrokerClient &&rhs) = default;
+
+    BrokerClient::~BrokerClient() = default;
+
+    void BrokerClient::set_timeout(unsigned timeout_ms) {
+        pimpl_->set_timeout(timeout_ms);
+    }
+
+    auto BrokerClient::write(std::vector<uint8_t> const &data) -> size_t {
+        return pimpl_->write(data);
+    }
+
+    auto BrokerClient::available() -> size_t {
+        return pimpl_->available();
+    }
+
+    auto BrokerClient::read() -> std::vector<uint8_t> {
+        return pimpl_->read();
+    }
+
+    void BrokerClient::read(std::vector<uint8_t> &buffer) {
+        pimpl_->read(buffer);
+    }
+
+    auto BrokerClient::lost_bytes() const -> uint64_t {
+        return pimpl_->lost_bytes();
+    }
+
+}
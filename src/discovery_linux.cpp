@@ -0,0 +1,341 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/discovery.h"
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <termios.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <map>
+#include <thread>
+#include <tuple>
+
+namespace ssp
+{
+    namespace {
+
+        constexpr unsigned max_reply_bytes = 256;  //largest Modbus RTU frame
+
+        auto modbus_crc(uint8_t const *data, size_t len) -> uint16_t
+        {
+            uint16_t crc = 0xffff;
+            for (size_t i = 0; i < len; ++i) {
+                crc ^= data[i];
+                for (auto bit = 0; bit < 8; ++bit) {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+                }
+            }
+            return crc;
+        }
+
+        auto default_candidates() -> std::vector<PortConfig>
+        {
+            //most common settings on the field first
+            return {
+                PortConfig{}.baud(Baudrate::_9600),
+                PortConfig{}.baud(Baudrate::_19200),
+                PortConfig{}.baud(Baudrate::_9600).parity(Parity::EVEN),
+                PortConfig{}.baud(Baudrate::_115200),
+                PortConfig{}.baud(Baudrate::_38400),
+                PortConfig{}.baud(Baudrate::_4800),
+                PortConfig{}.baud(Baudrate::_2400),
+                PortConfig{}.baud(Baudrate::_19200).parity(Parity::EVEN),
+                PortConfig{}.baud(Baudrate::_300).parity(Parity::EVEN).databits(Databits::_7),
+                PortConfig{}.baud(Baudrate::_1200),
+                PortConfig{}.baud(Baudrate::_9600).parity(Parity::EVEN).databits(Databits::_7),
+                PortConfig{}.baud(Baudrate::_9600).stopbits(Stopbits::_2),
+            };
+        }
+
+        //receive errors counted by the driver, zero when it does not keep counters
+        auto line_errors(int fd) -> uint64_t
+        {
+            struct serial_icounter_struct icount = {};
+            if (ioctl(fd, TIOCGICOUNT, &icount) < 0) {
+                return 0;
+            }
+            return static_cast<uint64_t>(icount.frame) + icount.parity + icount.brk;
+        }
+
+        struct BaudScore {
+            uint64_t bytes = 0;
+            uint64_t errors = 0;
+
+            //0 clean traffic seen, 1 nothing seen, 2 mostly errors
+            auto rank() const -> int
+            {
+                auto total = bytes + errors;
+                if (total == 0) {
+                    return 1;
+                }
+                return errors * 5 > total ? 2 : 0;
+            }
+        };
+
+        class Prober {
+
+            SerialPort port_;
+            int fd_;
+            DiscoveryOptions const &options_;
+            std::vector<std::atomic<unsigned>> &hits_;
+
+        public:
+            Prober(std::string const &id, DiscoveryOptions const &options, std::vector<std::atomic<unsigned>> &hits) :
+                port_{id, PortConfig{}.flow_control(FlowControl::NONE)},
+                fd_{port_.native_handle()},
+                options_{options},
+                hits_{hits} {};
+
+            void run(DiscoveryResult &result)
+            {
+                std::map<Baudrate, BaudScore> scores;
+                std::vector<size_t> remaining(options_.candidates.size());
+                for (size_t i = 0; i < remaining.size(); ++i) {
+                    remaining[i] = i;
+                }
+
+                while (!remaining.empty()) {
+                    auto next = std::min_element(remaining.begin(), remaining.end(), [&](size_t lhs, size_t rhs) {
+                        return key(lhs, scores) < key(rhs, scores);
+                    });
+                    auto index = *next;
+                    remaining.erase(next);
+
+                    //3-wire and RS-485 lines have no handshake, so probes never wait for CTS
+                    auto candidate = options_.candidates[index];
+                    candidate.flow_control(FlowControl::NONE);
+                    try {
+                        port_.apply(candidate);
+                    } catch (SerialErrorConfig const&) {
+                        continue; //settings the device cannot do
+                    }
+
+                    for (auto const &probe : options_.probes) {
+                        if (probe.accepts != nullptr && !probe.accepts(candidate)) {
+                            continue;
+                        }
+                        ++result.attempts;
+
+                        auto errors = line_errors(fd_);
+                        auto valid = exchange(probe, candidate, result.reply);
+                        auto &score = scores[candidate.baud()];
+                        score.bytes += result.reply.size();
+                        score.errors += line_errors(fd_) - errors;
+
+                        if (valid) {
+                            ++hits_[index];
+                            result.found = true;
+                            result.config = candidate;
+                            result.probe = probe.name;
+                            return;
+                        }
+                    }
+                }
+                result.reply.clear();
+            }
+
+        private:
+            auto key(size_t index, std::map<Baudrate, BaudScore> const &scores) const -> std::tuple<int, int, size_t>
+            {
+                auto baud = options_.candidates[index].baud();
+                auto score = scores.find(baud);
+                auto rank = score == scores.end() ? 1 : score->second.rank();
+                return std::make_tuple(rank, -static_cast<int>(hits_[index].load()), index);
+            }
+
+            /**
+             * Sends the probe request and collects the reply
+             * @return true as soon as the reply validates
+             */
+            auto exchange(DiscoveryProbe const &probe, PortConfig const &config, std::vector<uint8_t> &reply) -> bool
+            {
+                reply.clear();
+                tcflush(fd_, TCIOFLUSH);
+
+                size_t offset = 0;
+                while (offset < probe.request.size()) {
+                    auto n = ::write(fd_, probe.request.data() + offset, probe.request.size() - offset);
+                    if (n < 0 && errno != EINTR) {
+                        throw SerialErrorIO();
+                    }
+                    if (n > 0) {
+                        offset += static_cast<size_t>(n);
+                    }
+                }
+
+                auto char_ms = static_cast<int>((config.char_time_ns() + 999999) / 1000000);
+                auto gap = std::chrono::milliseconds(std::max<int>(options_.inter_char_timeout_ms, 5 * char_ms));
+                auto now = std::chrono::steady_clock::now();
+                auto next = now + std::chrono::milliseconds(probe.response_timeout_ms + probe.request.size() * char_ms);
+                //a longer stream than any probe reply is not worth waiting for
+                auto deadline = next + gap + std::chrono::milliseconds(max_reply_bytes * char_ms);
+
+                uint8_t buffer[256];
+                while (true) {
+                    auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::min(next, deadline) - now).count();
+                    if (timeout_ms <= 0) {
+                        return false;
+                    }
+                    struct pollfd pfd = {fd_, POLLIN, 0};
+                    auto res = poll(&pfd, 1, static_cast<int>(timeout_ms));
+                    now = std::chrono::steady_clock::now();
+                    if (res < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (res < 0) {
+                        throw SerialErrorIO();
+                    }
+                    if (res == 0) {
+                        return false;
+                    }
+                    if (!(pfd.revents & POLLIN)) {
+                        throw SerialErrorIO(); //hung up or failed
+                    }
+                    auto n = ::read(fd_, buffer, sizeof(buffer));
+                    if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+                        throw SerialErrorIO();
+                    }
+                    if (n > 0) {
+                        reply.insert(reply.end(), buffer, buffer + n);
+                        if (probe.validate(reply)) {
+                            return true;
+                        }
+                        next = now + gap;
+                    }
+                }
+            }
+        };
+    }
+
+    auto DiscoveryProbe::iec62056() -> DiscoveryProbe
+    {
+        DiscoveryProbe retval;
+        retval.name = "iec62056-21";
+        retval.request = {'/', '?', '!', '\r', '\n'};
+        retval.validate = [](std::vector<uint8_t> const &reply) {
+            auto start = std::find(reply.begin(), reply.end(), '/');
+            auto len = reply.end() - start;
+            return len >= 7 && reply[reply.size() - 2] == '\r' && reply.back() == '\n';
+        };
+        retval.accepts = [](PortConfig const &config) {
+            return config.baud() == Baudrate::_300 && config.parity() == Parity::EVEN && config.databits() == Databits::_7;
+        };
+        retval.response_timeout_ms = 1500; //maximum reaction time allowed by the standard
+        return retval;
+    }
+
+    auto DiscoveryProbe::modbus_rtu(uint8_t unit) -> DiscoveryProbe
+    {
+        DiscoveryProbe retval;
+        retval.name = "modbus-rtu";
+        retval.request = {unit, 0x03, 0x00, 0x00, 0x00, 0x01};
+        auto crc = modbus_crc(retval.request.data(), retval.request.size());
+        retval.request.push_back(static_cast<uint8_t>(crc & 0xff));
+        retval.request.push_back(static_cast<uint8_t>(crc >> 8));
+
+        retval.validate = [unit](std::vector<uint8_t> const &reply) {
+            if (reply.size() < 5 || reply[0] != unit) {
+                return false;
+            }
+            size_t len;
+            if (reply[1] == 0x83) {
+                len = 5; //exception reply still proves the settings
+            } else if (reply[1] == 0x03) {
+                len = 5u + reply[2];
+            } else {
+                return false;
+            }
+            if (reply.size() < len) {
+                return false;
+            }
+            auto crc = modbus_crc(reply.data(), len - 2);
+            return reply[len - 2] == (crc & 0xff) && reply[len - 1] == (crc >> 8);
+        };
+        retval.accepts = [](PortConfig const &config) {
+            return config.databits() == Databits::_8;
+        };
+        return retval;
+    }
+
+    auto discover(std::vector<SerialInfo> const &ports, DiscoveryOptions const &options) -> std::vector<DiscoveryResult>
+    {
+        auto effective = options;
+        if (effective.candidates.empty()) {
+            effective.candidates = default_candidates();
+        }
+        if (effective.probes.empty()) {
+            effective.probes = {DiscoveryProbe::iec62056(), DiscoveryProbe::modbus_rtu()};
+        }
+
+        std::vector<DiscoveryResult> retval(ports.size());
+        std::vector<std::atomic<unsigned>> hits(effective.candidates.size());
+        for (auto &hit : hits) {
+            hit.store(0);
+        }
+
+        std::atomic<size_t> next_port{0};
+        auto worker = [&] {
+            for (auto i = next_port++; i < ports.size(); i = next_port++) {
+                auto &result = retval[i];
+                result.port = ports[i];
+                result.found = false;
+                result.attempts = 0;
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    Prober(ports[i].id, effective, hits).run(result);
+                } catch (...) {
+                    result.error = std::current_exception();
+                }
+                result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            }
+        };
+
+        auto thread_count = effective.max_threads != 0 ? std::min<size_t>(effective.max_threads, ports.size()) : ports.size();
+        std::vector<std::thread> threads;
+        try {
+            for (size_t i = 0; i < thread_count; ++i) {
+                threads.push_back(start_thread(effective.threads, worker));
+            }
+        } catch (...) {
+            next_port = ports.size(); //let the started threads finish their current port
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            throw;
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        return retval;
+    }
+
+}
@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/iec62056.h"
+
+namespace ssp
+{
+    namespace {
+        constexpr uint8_t STX = 0x02;
+        constexpr uint8_t ETX = 0x03;
+    }
+
+    Iec62056Parser::Iec62056Parser(std::function<void(Iec62056DataSet const&)> on_data_set) :
+        on_data_set_{on_data_set}
+    {
+        reset();
+    }
+
+    void Iec62056Parser::reset()
+    {
+        state_ = State::WAIT_STX;
+        bcc_ = 0;
+        current_.address.clear();
+        current_.values.clear();
+    }
+
+    auto Iec62056Parser::complete() const -> bool
+    {
+        return state_ == State::DONE;
+    }
+
+    void Iec62056Parser::emit()
+    {
+        if (!current_.address.empty() || !current_.values.empty()) {
+            if (on_data_set_ != nullptr) {
+                on_data_set_(current_);
+            }
+        }
+        current_.address.clear();
+        current_.values.clear();
+    }
+
+    auto Iec62056Parser::feed(uint8_t const *data, size_t len) -> size_t
+    {
+        for (size_t i = 0; i < len; ++i) {
+            auto c = data[i];
+
+            switch (state_) {
+                case State::DONE:
+                    return i;
+                case State::WAIT_STX:
+                    if (c == STX) {
+                        state_ = State::ADDRESS;
+                    }
+                    continue;
+                case State::BCC:
+                    if (c != bcc_) {
+                        throw Iec62056ErrorBcc();
+                    }
+                    state_ = State::DONE;
+                    continue;
+                default:
+                    break;
+            }
+
+            bcc_ ^= c;
+            if (c == ETX) {
+                emit();
+                state_ = State::BCC;
+                continue;
+            }
+
+            switch (state_) {
+                case State::ADDRESS:
+                    if (c == '(') {
+                        current_.values.emplace_back();
+                        state_ = State::VALUE;
+                    } else if (c == '!' && current_.address.empty()) {
+                        state_ = State::END;
+                    } else if (c != '\r' && c != '\n') {
+                        current_.address.push_back(static_cast<char>(c));
+                    }
+                    break;
+                case State::VALUE:
+                    if (c == '*') {
+                        state_ = State::UNIT;
+                    } else if (c == ')') {
+                        state_ = State::AFTER_SET;
+                    } else {
+                        current_.values.back().value.push_back(static_cast<char>(c));
+                    }
+                    break;
+                case State::UNIT:
+                    if (c == ')') {
+                        state_ = State::AFTER_SET;
+                    } else {
+                        current_.values.back().unit.push_back(static_cast<char>(c));
+                    }
+                    break;
+                case State::AFTER_SET:
+                    if (c == '(') {
+                        current_.values.emplace_back();
+                        state_ = State::VALUE;
+                    } else {
+                        emit();
+                        if (c == '!') {
+                            state_ = State::END;
+                        } else {
+                            state_ = State::ADDRESS;
+                            if (c != '\r' && c != '\n') {
+                                current_.address.push_back(static_cast<char>(c));
+                            }
+                        }
+                    }
+                    break;
+                case State::END:
+                    if (c != '\r' && c != '\n') {
+                        throw Iec62056ErrorProtocol();
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return len;
+    }
+
+}
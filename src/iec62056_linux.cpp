@@ -0,0 +1,287 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/iec62056.h"
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+namespace ssp
+{
+    namespace {
+
+        constexpr uint8_t ACK = 0x06;
+
+        //mode C baud rate identification characters, '0' to '6'
+        constexpr Baudrate mode_c_rates[] = {
+            Baudrate::_300,
+            Baudrate::_600,
+            Baudrate::_1200,
+            Baudrate::_2400,
+            Baudrate::_4800,
+            Baudrate::_9600,
+            Baudrate::_19200
+        };
+
+        auto highest_baud_id(Baudrate max_baudrate) -> char
+        {
+            char retval = '0';
+            for (auto i = 0u; i < sizeof(mode_c_rates) / sizeof(mode_c_rates[0]); ++i) {
+                if (static_cast<unsigned>(mode_c_rates[i]) <= static_cast<unsigned>(max_baudrate)) {
+                    retval = static_cast<char>('0' + i);
+                }
+            }
+            return retval;
+        }
+
+        /**
+         * Waits for data and reads whatever is available
+         * @return the number of bytes read, zero on timeout
+         */
+        auto read_some(int fd, uint8_t *buffer, size_t len, unsigned timeout_ms) -> size_t
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            while (true) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                struct pollfd pfd = {fd, POLLIN, 0};
+                auto res = poll(&pfd, 1, remaining > 0 ? static_cast<int>(remaining) : 0);
+                if (res < 0 && errno != EINTR) {
+                    throw SerialErrorIO();
+                }
+                if (res > 0) {
+                    auto n = ::read(fd, buffer, len);
+                    if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                        throw SerialErrorIO();
+                    }
+                    if (n > 0) {
+                        return static_cast<size_t>(n);
+                    }
+                }
+                if (remaining <= 0) {
+                    return 0;
+                }
+            }
+        }
+
+        //SerialPort::write flushes the input after writing, which could discard a fast reply
+        void send(int fd, std::vector<uint8_t> const &data)
+        {
+            size_t offset = 0;
+            while (offset < data.size()) {
+                auto n = ::write(fd, data.data() + offset, data.size() - offset);
+                if (n < 0 && errno != EINTR) {
+                    throw SerialErrorIO();
+                }
+                if (n > 0) {
+                    offset += static_cast<size_t>(n);
+                }
+            }
+        }
+
+        /**
+         * Waits until the bytes just written have left the transmitter.
+         * Unlike tcdrain it gives up after the expected line time and a
+         * margin, so a stalled driver cannot hang the read out.
+         * @param bytes : number of bytes written
+         * @param char_ns : time of one character on the line
+         */
+        void drain(int fd, size_t bytes, uint64_t char_ns)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto estimate = start + std::chrono::nanoseconds(bytes * char_ns);
+            auto deadline = estimate + std::chrono::nanoseconds(2 * char_ns) + std::chrono::milliseconds(100);
+            auto step = std::chrono::nanoseconds(std::max<uint64_t>(char_ns / 2, 100000));
+
+            while (true) {
+                int queued = 0;
+                unsigned lsr = 0;
+                if (ioctl(fd, TIOCOUTQ, &queued) < 0) {
+                    throw SerialErrorIO();
+                }
+                auto lsr_supported = ioctl(fd, TIOCSERGETLSR, &lsr) == 0;
+                if (queued == 0 && (!lsr_supported || (lsr & TIOCSER_TEMT))) {
+                    //without the line status the last characters may still be in the hardware
+                    if (!lsr_supported) {
+                        std::this_thread::sleep_until(estimate);
+                    }
+                    return;
+                }
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    tcflush(fd, TCOFLUSH);
+                    throw SerialErrorTimeout();
+                }
+                std::this_thread::sleep_for(step);
+            }
+        }
+
+        auto parse_ident(std::string const &line) -> Iec62056Ident
+        {
+            //"/" XXX Z ident CR LF
+            if (line.size() < 7 || line[0] != '/') {
+                throw Iec62056ErrorProtocol();
+            }
+            Iec62056Ident retval;
+            retval.manufacturer = line.substr(1, 3);
+            retval.baud_id = line[4];
+            retval.identification = line.substr(5, line.size() - 7);
+            if (retval.baud_id < '0' || retval.baud_id > '6') {
+                throw Iec62056ErrorProtocol(); //not a mode C meter
+            }
+            retval.baudrate = mode_c_rates[retval.baud_id - '0'];
+            return retval;
+        }
+    }
+
+    Iec62056Client::Iec62056Client(SerialPort &port, Iec62056Options const &options) :
+        port_{port},
+        options_{options} {};
+
+    auto Iec62056Client::read_out(std::string const &address,
+                                  std::function<void(Iec62056DataSet const&)> on_data_set) -> Iec62056Readout
+    {
+        auto fd = port_.native_handle();
+        uint8_t buffer[256];
+        Iec62056Readout retval;
+
+        //optical heads have no handshake lines
+        auto config = PortConfig{Baudrate::_300, Parity::EVEN, Databits::_7, Stopbits::_1, options_.response_timeout_ms}
+                          .flow_control(FlowControl::NONE);
+        port_.apply(config);
+        tcflush(fd, TCIOFLUSH);
+
+        auto sign_on = "/?" + address + "!\r\n";
+        send(fd, std::vector<uint8_t>(sign_on.begin(), sign_on.end()));
+
+        //identification message, timestamped as soon as its LF arrives
+        std::string line;
+        auto timeout = options_.response_timeout_ms;
+        while (line.size() < 2 || line.compare(line.size() - 2, 2, "\r\n") != 0) {
+            auto n = read_some(fd, buffer, 1, timeout);
+            if (n == 0) {
+                throw SerialErrorTimeout();
+            }
+            line.push_back(static_cast<char>(buffer[0]));
+            timeout = options_.inter_char_timeout_ms;
+        }
+        auto ident_end = std::chrono::steady_clock::now();
+        auto start = line.find('/');
+        if (start == std::string::npos) {
+            throw Iec62056ErrorProtocol();
+        }
+        retval.ident = parse_ident(line.substr(start));
+
+        auto baud_id = std::min(retval.ident.baud_id, highest_baud_id(options_.max_baudrate));
+        retval.baudrate = mode_c_rates[baud_id - '0'];
+
+        //acknowledgement: protocol control '0', baud id, data readout mode '0'
+        std::this_thread::sleep_until(ident_end + std::chrono::milliseconds(options_.reaction_time_ms));
+        auto ack = std::vector<uint8_t>{ACK, '0', static_cast<uint8_t>(baud_id), '0', '\r', '\n'};
+        send(fd, ack);
+
+        //switch as soon as the last stop bit of the acknowledgement is out
+        drain(fd, ack.size(), config.char_time_ns());
+        port_.apply(config.baud(retval.baudrate));
+
+        auto parser = Iec62056Parser([&](Iec62056DataSet const &data_set) {
+            if (on_data_set != nullptr) {
+                on_data_set(data_set);
+            }
+            retval.data.push_back(data_set);
+        });
+
+        timeout = options_.response_timeout_ms;
+        while (!parser.complete()) {
+            auto n = read_some(fd, buffer, sizeof(buffer), timeout);
+            if (n == 0) {
+                throw SerialErrorTimeout();
+            }
+            parser.feed(buffer, n);
+            timeout = options_.inter_char_timeout_ms;
+        }
+
+        return retval;
+    }
+
+    auto iec62056_read_meters(std::vector<Iec62056Target> const &targets,
+                              Iec62056Options const &options,
+                              ThreadOptions const &threads) -> std::vector<Iec62056Result>
+    {
+        std::vector<Iec62056Result> retval(targets.size());
+
+        std::vector<std::pair<std::string, std::vector<size_t>>> by_port;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            auto it = std::find_if(by_port.begin(), by_port.end(), [&](auto const &entry) {
+                return entry.first == targets[i].port;
+            });
+            if (it == by_port.end()) {
+                by_port.emplace_back(targets[i].port, std::vector<size_t>{});
+                it = by_port.end() - 1;
+            }
+            it->second.push_back(i);
+        }
+
+        auto read_port = [&](std::pair<std::string, std::vector<size_t>> const &entry) {
+            try {
+                auto port = SerialPort(entry.first);
+                auto client = Iec62056Client(port, options);
+                for (auto index : entry.second) {
+                    try {
+                        retval[index].readout = client.read_out(targets[index].address);
+                    } catch (...) {
+                        retval[index].error = std::current_exception();
+                    }
+                }
+            } catch (...) {
+                for (auto index : entry.second) {
+                    retval[index].error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        try {
+            for (auto const &entry : by_port) {
+                workers.push_back(start_thread(threads, [&read_port, &entry] { read_port(entry); }));
+            }
+        } catch (...) {
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            throw;
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        return retval;
+    }
+
+}
@@ -0,0 +1,349 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/pacer.h"
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
+#include <termios.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+
+namespace ssp
+{
+    namespace {
+
+        constexpr uint64_t completion_margin_ns = 100000000; //allowed beyond the computed frame end
+
+        auto now_ns() -> uint64_t
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+        }
+    }
+
+    class TxPacer::impl {
+
+        SerialPort &port_;
+        int fd_;
+        int timer_fd_;
+        PacerOptions options_;
+        bool software_rs485_ = false;
+        bool kernel_rs485_ = false;
+        struct serial_rs485 saved_rs485_;
+        FlowControl saved_flow_;
+        uint64_t next_ns_ = 0;  //earliest start of the next frame
+
+        uint64_t frames_ = 0;
+        uint64_t late_frames_ = 0;
+        uint64_t samples_ = 0;
+        double jitter_sum_ = 0;
+        double jitter_sum_sq_ = 0;
+        double jitter_max_ = 0;
+
+    public:
+        impl(SerialPort &port, PacerOptions const &options) :
+            port_{port},
+            fd_{port.native_handle()},
+            options_{options},
+            saved_flow_{port.config().flow_control()}
+        {
+            if ((timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) {
+                throw SerialErrorConfig();
+            }
+            try {
+                configure_rs485();
+            } catch (...) {
+                restore_flow_control();
+                close(timer_fd_);
+                throw;
+            }
+        }
+
+        ~impl()
+        {
+            if (kernel_rs485_) {
+                ioctl(fd_, TIOCSRS485, &saved_rs485_);
+            }
+            restore_flow_control();
+            close(timer_fd_);
+        }
+
+        auto char_time_ns() const -> uint64_t
+        {
+            return port_.config().char_time_ns();
+        }
+
+        auto send(std::vector<uint8_t> const &frame) -> size_t
+        {
+            auto char_ns = char_time_ns();
+            auto gap_ns = options_.inter_frame_gap_us != 0 ? options_.inter_frame_gap_us * 1000ull : char_ns * 7 / 2;
+
+            //only frames that had to wait for the gap have a schedule to be late against
+            if (next_ns_ != 0 && now_ns() < next_ns_) {
+                sleep_until(next_ns_);
+                auto woke = now_ns();
+                if (woke - next_ns_ > char_ns) {
+                    ++late_frames_;
+                }
+                record_jitter(static_cast<double>(woke - next_ns_) / 1000.0);
+            }
+
+            if (software_rs485_) {
+                set_rts(options_.rs485.rts_on_send);
+                if (options_.rs485.delay_rts_before_send_ms != 0) {
+                    sleep_until(now_ns() + options_.rs485.delay_rts_before_send_ms * 1000000ull);
+                }
+            }
+
+            auto start = now_ns();
+            ++frames_;
+
+            write_all(frame);
+
+            auto estimate = start + frame.size() * char_ns;
+            auto deadline = estimate + 2 * char_ns + completion_margin_ns;
+            auto end = wait_completion(estimate, deadline, char_ns);
+
+            if (software_rs485_) {
+                sleep_until(end + options_.rs485.delay_rts_after_send_ms * 1000000ull);
+                set_rts(options_.rs485.rts_after_send);
+            }
+
+            next_ns_ = end + gap_ns;
+            return frame.size();
+        }
+
+        auto stats() const -> PacerStats
+        {
+            PacerStats retval;
+            retval.frames = frames_;
+            retval.late_frames = late_frames_;
+            retval.jitter_mean_us = samples_ != 0 ? jitter_sum_ / samples_ : 0;
+            retval.jitter_max_us = jitter_max_;
+            auto variance = samples_ != 0 ? jitter_sum_sq_ / samples_ - retval.jitter_mean_us * retval.jitter_mean_us : 0;
+            retval.jitter_stddev_us = std::sqrt(std::max(variance, 0.0));
+            return retval;
+        }
+
+        void reset_stats()
+        {
+            frames_ = 0;
+            late_frames_ = 0;
+            samples_ = 0;
+            jitter_sum_ = 0;
+            jitter_sum_sq_ = 0;
+            jitter_max_ = 0;
+        }
+
+    private:
+        void configure_rs485()
+        {
+            auto const &rs485 = options_.rs485;
+            if (rs485.mode == Rs485Mode::OFF) {
+                return;
+            }
+
+            //transceivers do not drive CTS, and under CRTSCTS the driver owns RTS
+            port_.apply(port_.config().flow_control(FlowControl::NONE));
+
+            if (rs485.mode == Rs485Mode::KERNEL || rs485.mode == Rs485Mode::AUTO) {
+                struct serial_rs485 params = {};
+                params.flags = SER_RS485_ENABLED;
+                if (rs485.rts_on_send) {
+                    params.flags |= SER_RS485_RTS_ON_SEND;
+                }
+                if (rs485.rts_after_send) {
+                    params.flags |= SER_RS485_RTS_AFTER_SEND;
+                }
+                if (rs485.rx_during_tx) {
+                    params.flags |= SER_RS485_RX_DURING_TX;
+                }
+                params.delay_rts_before_send = rs485.delay_rts_before_send_ms;
+                params.delay_rts_after_send = rs485.delay_rts_after_send_ms;
+
+                if (ioctl(fd_, TIOCGRS485, &saved_rs485_) == 0 && ioctl(fd_, TIOCSRS485, &params) == 0) {
+                    kernel_rs485_ = true;
+                    return;
+                }
+                if (rs485.mode == Rs485Mode::KERNEL) {
+                    throw SerialErrorConfig();
+                }
+            }
+
+            software_rs485_ = true;
+            set_rts(rs485.rts_after_send);
+        }
+
+        void restore_flow_control()
+        {
+            if (options_.rs485.mode != Rs485Mode::OFF) {
+                try {
+                    port_.apply(port_.config().flow_control(saved_flow_));
+                } catch (SerialErrorConfig const&) {
+                }
+            }
+        }
+
+        void set_rts(bool asserted)
+        {
+            int bits = TIOCM_RTS;
+            if (ioctl(fd_, asserted ? TIOCMBIS : TIOCMBIC, &bits) < 0) {
+                throw SerialErrorIO();
+            }
+        }
+
+        void sleep_until(uint64_t deadline_ns)
+        {
+            if (now_ns() >= deadline_ns) {
+                return;
+            }
+            struct itimerspec its = {};
+            its.it_value.tv_sec = static_cast<time_t>(deadline_ns / 1000000000ull);
+            its.it_value.tv_nsec = static_cast<long>(deadline_ns % 1000000000ull);
+            if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr) < 0) {
+                throw SerialErrorIO();
+            }
+            uint64_t expirations;
+            while (::read(timer_fd_, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+            }
+        }
+
+        void write_all(std::vector<uint8_t> const &frame)
+        {
+            size_t offset = 0;
+            while (offset < frame.size()) {
+                auto res = ::write(fd_, frame.data() + offset, frame.size() - offset);
+                if (res > 0) {
+                    offset += static_cast<size_t>(res);
+                } else if (res < 0 && errno == EAGAIN) {
+                    struct pollfd pfd = {fd_, POLLOUT, 0};
+                    poll(&pfd, 1, -1);
+                } else if (res < 0 && errno != EINTR) {
+                    throw SerialErrorIO();
+                }
+            }
+        }
+
+        /**
+         * Waits until the frame has left the transmitter, as configured
+         * @return the time the frame ended on the line
+         */
+        auto wait_completion(uint64_t estimate_ns, uint64_t deadline_ns, uint64_t char_ns) -> uint64_t
+        {
+            auto completion = options_.completion;
+            if (completion == TxCompletion::NONE) {
+                if (!software_rs485_) {
+                    return estimate_ns;
+                }
+                //RTS may only be released once the last stop bit is out
+                sleep_until(estimate_ns);
+                return estimate_ns;
+            }
+
+            if (completion == TxCompletion::LSR) {
+                //sleep through most of the frame, then poll with character resolution
+                sleep_until(estimate_ns > char_ns ? estimate_ns - char_ns : estimate_ns);
+                unsigned lsr = 0;
+                while (ioctl(fd_, TIOCSERGETLSR, &lsr) == 0) {
+                    auto now = now_ns();
+                    if (lsr & TIOCSER_TEMT) {
+                        return now;
+                    }
+                    if (now >= deadline_ns) {
+                        tcflush(fd_, TCOFLUSH);
+                        throw SerialErrorTimeout();
+                    }
+                    sleep_until(std::min(deadline_ns, now + std::max<uint64_t>(char_ns / 2, 10000)));
+                }
+                //driver without line status support
+            }
+
+            //tcdrain has no timeout, it is only called once the driver queue is empty
+            wait_output_queue(deadline_ns, char_ns);
+            if (tcdrain(fd_) < 0) {
+                throw SerialErrorIO();
+            }
+            return now_ns();
+        }
+
+        void wait_output_queue(uint64_t deadline_ns, uint64_t char_ns)
+        {
+            while (true) {
+                int queued = 0;
+                if (ioctl(fd_, TIOCOUTQ, &queued) < 0) {
+                    throw SerialErrorIO();
+                }
+                if (queued == 0) {
+                    return;
+                }
+                auto now = now_ns();
+                if (now >= deadline_ns) {
+                    tcflush(fd_, TCOFLUSH);
+                    throw SerialErrorTimeout();
+                }
+                sleep_until(std::min(deadline_ns, now + std::max<uint64_t>(char_ns / 2, 10000)));
+            }
+        }
+
+        void record_jitter(double jitter_us)
+        {
+            ++samples_;
+            jitter_sum_ += jitter_us;
+            jitter_sum_sq_ += jitter_us * jitter_us;
+            jitter_max_ = std::max(jitter_max_, jitter_us);
+        }
+    };
+
+    TxPacer::TxPacer(SerialPort &port, PacerOptions const &options) :
+        pimpl_{std::make_unique<impl>(port, options)} {};
+
+    TxPacer::TxPacer(TxPacer &&rhs) = default;
+
+    TxPacer::~TxPacer() = default;
+
+    auto TxPacer::send(std::vector<uint8_t> const &frame) -> size_t {
+        return pimpl_->send(frame);
+    }
+
+    auto TxPacer::char_time_ns() const -> uint64_t {
+        return pimpl_->char_time_ns();
+    }
+
+    auto TxPacer::stats() const -> PacerStats {
+        return pimpl_->stats();
+    }
+
+    void TxPacer::reset_stats() {
+        pimpl_->reset_stats();
+    }
+
+}
@@ -29,7 +29,12 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <dirent.h>
+#include <poll.h>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <fstream>
 #include <unistd.h>
 #include <chrono>
 
@@ -38,21 +43,43 @@ namespace ssp
     struct SerialPort::impl {
 
         int fd; //file descriptor
-        unsigned timeout_ms_;
+        struct termios tio_;  //settings last written to the driver
+        PortConfig config_;
         std::function<void(const std::vector<uint8_t>&)> rx_listener = nullptr;
         std::function<void(const std::vector<uint8_t>&)> tx_listener = nullptr;
 
-        impl(std::string const &id,
-             Baudrate baud,
-             Parity par,
-             Databits dbits,
-             Stopbits sbits,
-             unsigned timeout_ms)
+        impl(std::string const &id, PortConfig const &config)
         {
             if ((fd = open(id.c_str(), O_RDWR | O_NOCTTY)) < 0) {
                 throw SerialErrorOpening();
             }
-            set_params(Baudrate::_9600, Parity::NONE, Databits::_8, Stopbits::_1, timeout_ms);
+
+            struct termios params;
+            if (tcgetattr(fd, &params) < 0) {
+                close(fd);
+                throw SerialErrorConfig();
+            }
+
+            //configure input flags
+            params.c_iflag = IGNPAR;    //ignores bytes with framing or parity errors
+
+            //configure control flags
+            params.c_cflag = CREAD |    //enables receive
+                             CLOCAL;    //ignores modem control lines
+
+            params.c_lflag = 0; //non-canonical, no echo
+            params.c_oflag = 0; //raw output
+            params.c_cc[VMIN] = 0;
+            params.c_cc[VTIME] = 0;
+
+            try {
+                encode(params, config);
+                commit(params, ApplyMode::NOW);
+            } catch (SerialErrorConfig const&) {
+                close(fd);
+                throw;
+            }
+            config_ = config;
         }
 
         ~impl()
@@ -71,54 +98,117 @@ namespace ssp
         static auto available_ports() -> std::vector<SerialInfo>
         {
             std::vector<SerialInfo> retval;
-            return retval;
-        }
+            auto dir = opendir("/sys/class/tty");
+            if (dir == nullptr) {
+                return retval;
+            }
 
-        void set_params(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms)
-        {
-            struct termios params;
-            memset(&params, 0, sizeof(params));
+            while (auto entry = readdir(dir)) {
+                auto name = std::string{entry->d_name};
+                auto base = "/sys/class/tty/" + name;
 
-            timeout_ms_ = timeout_ms;
+                //only ttys backed by a device with a driver are serial ports
+                struct stat st;
+                if (name[0] == '.' || stat((base + "/device/driver").c_str(), &st) < 0) {
+                    continue;
+                }
 
-            //configure input flags
-            params.c_iflag = IGNPAR |   //
-                             ICRNL;     //
+                //the 8250 driver registers every legacy port, even without a uart
+                std::ifstream type(base + "/type");
+                auto uart = 0;
+                if (type >> uart && uart == 0) {
+                    continue;
+                }
 
-            //configure control flags
-            params.c_cflag = CREAD |    //enables receive
-                             CLOCAL |   //ignores modem control lines
-                             CRTSCTS;   //enables RTS/CTS control
+                retval.push_back(SerialInfo{"/dev/" + name});
+            }
+            closedir(dir);
 
-            params.c_lflag = 0; //non-canonical, no echo
-            params.c_oflag = 0; //raw output
+            std::sort(retval.begin(), retval.end(), [](SerialInfo const &lhs, SerialInfo const &rhs) {
+                return lhs.id < rhs.id;
+            });
+            return retval;
+        }
+
+        void apply(PortConfig const &config, ApplyMode mode)
+        {
+            //the timeout lives only in this process, it never needs an ioctl
+            if (config.same_line(config_)) {
+                config_ = config;
+                return;
+            }
 
+            auto params = tio_;
+            encode(params, config);
+            if (params.c_cflag != tio_.c_cflag ||
+                cfgetispeed(&params) != cfgetispeed(&tio_) ||
+                cfgetospeed(&params) != cfgetospeed(&tio_)) {
+                commit(params, mode);
+            }
+            config_ = config;
+        }
+
+        static auto speed(Baudrate baud) -> speed_t
+        {
             switch(baud) {
                 case Baudrate::_110:
-                    params.c_cflag |= B110;
-                    break;
+                    return B110;
                 case Baudrate::_300:
-                    params.c_cflag |= B300;
-                    break;
+                    return B300;
+                case Baudrate::_600:
+                    return B600;
+                case Baudrate::_1200:
+                    return B1200;
+                case Baudrate::_2400:
+                    return B2400;
+                case Baudrate::_4800:
+                    return B4800;
                 case Baudrate::_9600:
-                    params.c_cflag |= B9600;
-                    break;
+                    return B9600;
+                case Baudrate::_19200:
+                    return B19200;
+                case Baudrate::_38400:
+                    return B38400;
+                case Baudrate::_115200:
+                    return B115200;
+                default:
+                    throw SerialErrorConfig(); //eg 14400, not a termios standard rate
+            }
+        }
+
+        /**
+         * Writes the line settings into params, leaving every other flag untouched
+         */
+        static void encode(struct termios &params, PortConfig const &config)
+        {
+            auto baud = speed(config.baud());
+            cfsetispeed(&params, baud);
+            cfsetospeed(&params, baud);
+
+            params.c_cflag &= ~(PARENB | PARODD | CMSPAR | CSIZE | CSTOPB | CRTSCTS);
+
+            if (config.flow_control() == FlowControl::RTS_CTS) {
+                params.c_cflag |= CRTSCTS;  //enables RTS/CTS control
             }
 
-            switch (par) {
+            switch (config.parity()) {
                 case Parity::NONE:
-                    params.c_cflag &= ~PARENB;
                     break;
                 case Parity::EVEN:
                     params.c_cflag |= PARENB;
                     break;
                 case Parity::ODD:
-                    params.c_cflag |= PARENB;
-                    params.c_cflag |= PARODD;
+                    params.c_cflag |= PARENB | PARODD;
+                    break;
+                case Parity::MARK:
+                    params.c_cflag |= PARENB | CMSPAR | PARODD;
+                    break;
+                case Parity::SPACE:
+                    params.c_cflag |= PARENB | CMSPAR;
                     break;
             }
 
-            switch (dbits) {
+            switch (config.databits()) {
                 case Databits::_5:
                     params.c_cflag |= CS5;
                     break;
@@ -133,9 +223,8 @@ namespace ssp
                     break;
             }
 
-            switch (sbits) {
+            switch (config.stopbits()) {
                 case Stopbits::_1:
-                    params.c_cflag &= ~CSTOPB;
                     break;
                 case Stopbits::_1POINT5:
                     params.c_cflag |= CSTOPB;
@@ -144,13 +233,30 @@ namespace ssp
                     params.c_cflag |= CSTOPB;
                     break;
             }
+        }
 
-            tcsetattr(fd, TCSANOW, &params);
+        void commit(struct termios const &params, ApplyMode mode)
+        {
+            if (tcsetattr(fd, mode == ApplyMode::DRAIN ? TCSADRAIN : TCSANOW, &params) < 0) {
+                throw SerialErrorConfig();
+            }
+            tio_ = params;
         }
 
         auto write(std::vector<uint8_t> const &data) -> size_t
         {
-            auto written = ::write(fd, data.data(), data.size());
+            size_t written = 0;
+            while (written < data.size()) {
+                auto res = ::write(fd, data.data() + written, data.size() - written);
+                if (res > 0) {
+                    written += static_cast<size_t>(res);
+                } else if (res < 0 && errno == EAGAIN) {
+                    struct pollfd pfd = {fd, POLLOUT, 0};
+                    poll(&pfd, 1, -1);
+                } else if (res < 0 && errno != EINTR) {
+                    throw SerialErrorIO();
+                }
+            }
             tcflush(fd, TCIFLUSH);
             if (tx_listener != nullptr) {
                 tx_listener(data);
@@ -177,7 +283,7 @@ namespace ssp
                 for (auto i = 0; i < res; ++i) {
                     buffer.push_back(temp[i]);
                 }
-            } while (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() < timeout_ms_);
+            } while (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() < config_.timeout());
         }
 
     };
@@ -187,14 +293,45 @@ namespace ssp
     }
 
     SerialPort::SerialPort(std::string const &id, Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms) :
-        pimpl_{std::make_unique<impl>(id, baud, par, dbits, sbits, timeout_ms)} {};
+        SerialPort(id, PortConfig{baud, par, dbits, sbits, timeout_ms}) {};
+
+    SerialPort::SerialPort(std::string const &id, PortConfig const &config) :
+        pimpl_{std::make_unique<impl>(id, config)} {};
     
     SerialPort::~SerialPort()  = default;
 
     SerialPort::SerialPort(SerialPort &&rhs) = default;
 
     void SerialPort::set_params(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms) {
-        pimpl_->set_params(baud, par, dbits, sbits, timeout_ms);
+        pimpl_->apply(PortConfig{baud, par, dbits, sbits, timeout_ms}, ApplyMode::NOW);
+    }
+
+    void SerialPort::set_baud(Baudrate baud) {
+        pimpl_->apply(PortConfig{pimpl_->config_}.baud(baud), ApplyMode::NOW);
+    }
+
+    void SerialPort::set_parity(Parity par) {
+        pimpl_->apply(PortConfig{pimpl_->config_}.parity(par), ApplyMode::NOW);
+    }
+
+    void SerialPort::set_databits(Databits dbits) {
+        pimpl_->apply(PortConfig{pimpl_->config_}.databits(dbits), ApplyMode::NOW);
+    }
+
+    void SerialPort::set_stopbits(Stopbits sbits) {
+        pimpl_->apply(PortConfig{pimpl_->config_}.stopbits(sbits), ApplyMode::NOW);
+    }
+
+    void SerialPort::set_timeout(unsigned timeout_ms) {
+        pimpl_->apply(PortConfig{pimpl_->config_}.timeout(timeout_ms), ApplyMode::NOW);
+    }
+
+    void SerialPort::apply(PortConfig const &config, ApplyMode mode) {
+        pimpl_->apply(config, mode);
+    }
+
+    auto SerialPort::config() const -> PortConfig {
+        return pimpl_->config_;
     }
 
     auto SerialPort::write(std::vector<uint8_t> const& data) -> size_t {
@@ -209,6 +346,10 @@ namespace ssp
         pimpl_->read(buffer);
     }
 
+    auto SerialPort::native_handle() const -> native_handle_type {
+        return pimpl_->fd;
+    }
+
     void SerialPort::install_rx_listener(std::function<void(const std::vector<uint8_t>&)> func) {
         pimpl_->install_rx_listener(func);
     }
@@ -36,11 +36,7 @@ namespace ssp
 class SerialPort::impl
 {
     HANDLE hserial_ = NULL;
-    Baudrate baud_;
-    Parity   parity_;
-    Databits dbits_;
-    Stopbits sbits_;
-    unsigned timeout_ms_;
+    PortConfig config_;
     unsigned inter_byte_timeout_ms_ = 50;
     std::function<void(const std::vector<uint8_t>&)> rx_listener = nullptr;
     std::function<void(const std::vector<uint8_t>&)> tx_listener = nullptr;
@@ -55,17 +51,8 @@ public:
         return retval;
     }
 
-    impl(std::string const &id,
-         Baudrate baud,
-         Parity par,
-         Databits dbits,
-         Stopbits sbits,
-         unsigned timeout) :
-             baud_{baud},
-             parity_{par},
-             dbits_{dbits},
-             sbits_{sbits},
-             timeout_ms_{timeout}
+    impl(std::string const &id, PortConfig const &config) :
+             config_{config}
 	{
 		auto long_prefix = std::string{R"(\\.\)"};
 		auto prefix = std::string{ "COM" };
@@ -103,44 +90,25 @@ public:
         tx_listener = func;
     }
 
-    void set_params(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms)
+    void apply(PortConfig const &config, ApplyMode mode)
     {
-        baud_ = baud;
-        parity_ = par;
-        dbits_ = dbits;
-        sbits_ = sbits;
-        timeout_ms_ = timeout_ms;
-        configure_port();
-    }
-
-    void set_baud(Baudrate baud)
-    {
-        baud_ = baud;
-        configure_port();
-    }
-
-    void set_parity(Parity par)
-    {
-        parity_ = par;
-        configure_port();
-    }
-
-    void set_databits(Databits dbits)
-    {
-        dbits_ = dbits;
-        configure_port();
-    }
+        auto line_changed = !config.same_line(config_);
+        auto timeout_changed = config.timeout() != config_.timeout();
+        config_ = config;
 
-    void set_stopbits(Stopbits sbits)
-    {
-        sbits_ = sbits;
-        configure_port();
+        if (line_changed) {
+            if (mode == ApplyMode::DRAIN) {
+                FlushFileBuffers(hserial_);
+            }
+            configure_port();
+        } else if (timeout_changed) {
+            configure_timeout();
+        }
     }
 
-    void set_timeout(unsigned timeout_ms)
+    auto config() const -> PortConfig
     {
-        timeout_ms_ = timeout_ms;
-        configure_timeout();
+        return config_;
     }
 
     auto write(std::vector<uint8_t> const &data) -> size_t
@@ -174,6 +142,11 @@ public:
         return retval;
     }
 
+    auto native_handle() const -> HANDLE
+    {
+        return hserial_;
+    }
+
     void read(std::vector<uint8_t> &buffer)
     {
         std::array<uint8_t,128> temp;
@@ -206,7 +179,7 @@ private:
         }
 
         com_timeout.ReadIntervalTimeout = inter_byte_timeout_ms_;
-        com_timeout.ReadTotalTimeoutConstant = timeout_ms_;
+        com_timeout.ReadTotalTimeoutConstant = config_.timeout();
         com_timeout.ReadTotalTimeoutMultiplier = 0;
 
         if (!SetCommTimeouts(hserial_, &com_timeout)) {
@@ -222,18 +195,19 @@ private:
             throw SerialErrorConfig();
         }
 
-        dcb_params.fOutxCtsFlow = false;
-        dcb_params.fRtsControl = 0x00;
+        auto handshake = config_.flow_control() == FlowControl::RTS_CTS;
+        dcb_params.fOutxCtsFlow = handshake;
+        dcb_params.fRtsControl = handshake ? RTS_CONTROL_HANDSHAKE : RTS_CONTROL_DISABLE;
         dcb_params.fOutX = false;
         dcb_params.fInX = false;
 
-        dcb_params.BaudRate = static_cast<unsigned>(baud_);
-        inter_byte_timeout_ms_= static_cast<unsigned>(baud_)/8;
+        dcb_params.BaudRate = static_cast<unsigned>(config_.baud());
+        inter_byte_timeout_ms_= static_cast<unsigned>(config_.baud())/8;
         inter_byte_timeout_ms_ = 1200/inter_byte_timeout_ms_;
         inter_byte_timeout_ms_ = inter_byte_timeout_ms_ < 50 ? 50 : inter_byte_timeout_ms_;
         configure_timeout();
 
-        switch (parity_) {
+        switch (config_.parity()) {
             case Parity::EVEN:
                 dcb_params.Parity = EVENPARITY;
                 break;
@@ -251,7 +225,7 @@ private:
                 break;
         }
 
-        switch (dbits_) {
+        switch (config_.databits()) {
             case Databits::_5:
                 dcb_params.ByteSize = 5;
                 break;
@@ -266,7 +240,7 @@ private:
                 break;
         }
 
-        switch (sbits_) {
+        switch (config_.stopbits()) {
             case Stopbits::_1:
                 dcb_params.StopBits = ONESTOPBIT;
                 break;
@@ -291,13 +265,26 @@ auto SerialPort::available_ports() -> std::vector<SerialInfo>
 }
 
 SerialPort::SerialPort(std::string const &id, Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms) :
-                         pimpl_{std::make_unique<impl>(id, baud, par, dbits, sbits, timeout_ms)} {};
+                         SerialPort(id, PortConfig{baud, par, dbits, sbits, timeout_ms}) {};
+
+SerialPort::SerialPort(std::string const &id, PortConfig const &config) :
+                         pimpl_{std::make_unique<impl>(id, config)} {};
 
 SerialPort::~SerialPort() = default;
 
 void SerialPort::set_params(Baudrate baud, Parity par, Databits dbits, Stopbits sbits, unsigned timeout_ms)
 {
-    pimpl_->set_params(baud, par, dbits, sbits, timeout_ms);
+    pimpl_->apply(PortConfig{baud, par, dbits, sbits, timeout_ms}, ApplyMode::NOW);
+}
+
+void SerialPort::apply(PortConfig const &config, ApplyMode mode)
+{
+    pimpl_->apply(config, mode);
+}
+
+auto SerialPort::config() const -> PortConfig
+{
+    return pimpl_->config();
 }
 
 auto SerialPort::write(std::vector<uint8_t> const &data) -> size_t
@@ -320,29 +307,34 @@ void SerialPort::read(std::vector<uint8_t> &buffer)
     pimpl_->read(buffer);
 }
 
+auto SerialPort::native_handle() const -> native_handle_type
+{
+    return pimpl_->native_handle();
+}
+
 void SerialPort::set_baud(Baudrate baud)
 {
-    pimpl_->set_baud(baud);
+    pimpl_->apply(pimpl_->config().baud(baud), ApplyMode::NOW);
 }
 
 void SerialPort::set_parity(Parity par)
 {
-    pimpl_->set_parity(par);
+    pimpl_->apply(pimpl_->config().parity(par), ApplyMode::NOW);
 }
 
 void SerialPort::set_databits(Databits dbits)  
 {
-    pimpl_->set_databits(dbits);
+    pimpl_->apply(pimpl_->config().databits(dbits), ApplyMode::NOW);
 }
 
 void SerialPort::set_stopbits(Stopbits sbits)
 {
-    pimpl_->set_stopbits(sbits);
+    pimpl_->apply(pimpl_->config().stopbits(sbits), ApplyMode::NOW);
 }
 
 void SerialPort::set_timeout(unsigned timeout_ms)
 {
-    pimpl_->set_timeout(timeout_ms);
+    pimpl_->apply(pimpl_->config().timeout(timeout_ms), ApplyMode::NOW);
 }
 
 void SerialPort::install_rx_listener(std::function<void(const std::vector<uint8_t>&)> func) {
@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+///@file
+
+#include "ssp/threading.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+namespace ssp
+{
+    namespace {
+
+        auto bucket_of(uint64_t latency_ns) -> size_t
+        {
+            size_t retval = 0;
+            while (latency_ns != 0 && retval < LatencyHistogram::buckets - 1) {
+                latency_ns >>= 1;
+                ++retval;
+            }
+            return retval;
+        }
+    }
+
+    auto LatencyHistogram::percentile_ns(double percentile) const -> uint64_t
+    {
+        if (samples == 0) {
+            return 0;
+        }
+        auto target = static_cast<uint64_t>(percentile / 100.0 * samples);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets - 1; ++i) {
+            seen += counts[i];
+            if (seen > target || seen == samples) {
+                return std::min<uint64_t>(1ull << i, max_ns);
+            }
+        }
+        return max_ns;
+    }
+
+    LatencyRecorder::LatencyRecorder() :
+        max_ns_{0}
+    {
+        for (auto &count : counts_) {
+            count.store(0);
+        }
+    }
+
+    void LatencyRecorder::record(uint64_t latency_ns)
+    {
+        //a single thread records, relaxed updates are enough for the readers
+        counts_[bucket_of(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+        if (latency_ns > max_ns_.load(std::memory_order_relaxed)) {
+            max_ns_.store(latency_ns, std::memory_order_relaxed);
+        }
+    }
+
+    auto LatencyRecorder::snapshot() const -> LatencyHistogram
+    {
+        LatencyHistogram retval;
+        retval.samples = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            retval.counts[i] = counts_[i].load(std::memory_order_relaxed);
+            retval.samples += retval.counts[i];
+        }
+        retval.max_ns = max_ns_.load(std::memory_order_relaxed);
+        return retval;
+    }
+
+    auto start_thread(ThreadOptions const &options, std::function<void()> body) -> std::thread
+    {
+        std::promise<void> started;
+        auto result = started.get_future();
+        std::thread retval([options, body, started = std::move(started)]() mutable {
+            try {
+                apply_thread_options(options);
+            } catch (...) {
+                started.set_exception(std::current_exception());
+                return;
+            }
+            started.set_value();
+            body();
+        });
+
+        try {
+            result.get();
+        } catch (...) {
+            retval.join();
+            throw;
+        }
+        return retval;
+    }
+
+    auto busy_poll(unsigned window_us, std::function<bool()> const &ready) -> bool
+    {
+        if (ready()) {
+            return true;
+        }
+        if (window_us == 0) {
+            return false;
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(window_us);
+        do {
+            if (ready()) {
+                return true;
+            }
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
+
+}
@@ -0,0 +1,170 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+///@file
+
+#include "ssp/threading.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace ssp
+{
+    namespace {
+
+        //parses a sysfs cpu list, eg "0-3,8-11"
+        auto node_cpus(int node) -> std::vector<unsigned>
+        {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!std::getline(file, list)) {
+                throw SerialErrorThreadConfig();
+            }
+
+            std::vector<unsigned> retval;
+            std::istringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                if (range.empty()) {
+                    continue;
+                }
+                auto dash = range.find('-');
+                auto first = std::stoul(range.substr(0, dash));
+                auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (auto cpu = first; cpu <= last; ++cpu) {
+                    retval.push_back(static_cast<unsigned>(cpu));
+                }
+            }
+            return retval;
+        }
+
+        void set_affinity(std::vector<unsigned> const &cpus)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu : cpus) {
+                if (cpu >= CPU_SETSIZE) {
+                    throw SerialErrorThreadConfig();
+                }
+                CPU_SET(cpu, &set);
+            }
+            if (CPU_COUNT(&set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                throw SerialErrorThreadConfig();
+            }
+        }
+
+        //allocations of the thread come from the node while it has memory
+        void prefer_node(int node)
+        {
+            unsigned long mask[16] = {};
+            auto bits = 8 * sizeof(mask[0]);
+            if (static_cast<size_t>(node) >= bits * 16) {
+                throw SerialErrorThreadConfig();
+            }
+            mask[node / bits] = 1ul << (node % bits);
+            if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, bits * 16 + 1) < 0) {
+                throw SerialErrorThreadConfig();
+            }
+        }
+
+        //room left for the frames the thread body still needs
+        constexpr size_t stack_margin = 64 * 1024;
+
+        void prefault_stack(size_t bytes)
+        {
+            pthread_attr_t attr;
+            void *low;
+            size_t size;
+            if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+                throw SerialErrorThreadConfig();
+            }
+            auto res = pthread_attr_getstack(&attr, &low, &size);
+            pthread_attr_destroy(&attr);
+
+            //the stack grows down, what is left lies between here and its lowest address
+            char here;
+            auto left = static_cast<size_t>(&here - static_cast<char*>(low));
+            if (res != 0 || bytes + stack_margin > left) {
+                throw SerialErrorThreadConfig();
+            }
+
+            auto stack = static_cast<volatile char*>(alloca(bytes));
+            auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t i = 0; i < bytes; i += page) {
+                stack[i] = 0;
+            }
+        }
+    }
+
+    void apply_thread_options(ThreadOptions const &options)
+    {
+        if (options.numa_node >= 0) {
+            auto allowed = node_cpus(options.numa_node);
+            auto cpus = options.cpus;
+            if (!cpus.empty()) {
+                cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](unsigned cpu) {
+                    return std::find(allowed.begin(), allowed.end(), cpu) == allowed.end();
+                }), cpus.end());
+                if (cpus.empty()) {
+                    throw SerialErrorThreadConfig(); //none of the cpus belongs to the node
+                }
+            } else {
+                cpus = allowed;
+            }
+            set_affinity(cpus);
+            prefer_node(options.numa_node);
+        } else if (!options.cpus.empty()) {
+            set_affinity(options.cpus);
+        }
+
+        if (options.priority != 0) {
+            struct sched_param param = {};
+            param.sched_priority = options.priority;
+            if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+                throw SerialErrorThreadConfig();
+            }
+        }
+
+        if (options.prefault_stack_bytes != 0) {
+            prefault_stack(options.prefault_stack_bytes);
+        }
+    }
+
+    void lock_memory()
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+            throw SerialErrorThreadConfig();
+        }
+    }
+
+}
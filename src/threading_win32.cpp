@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+///@file
+
+#include "ssp/threading.h"
+#include <windows.h>
+#include <malloc.h>
+
+namespace ssp
+{
+    namespace {
+
+        //room left for the frames the thread body still needs
+        constexpr size_t stack_margin = 64 * 1024;
+    }
+
+    void apply_thread_options(ThreadOptions const &options)
+    {
+        DWORD_PTR mask = 0;
+        for (auto cpu : options.cpus) {
+            if (cpu >= 8 * sizeof(mask)) {
+                throw SerialErrorThreadConfig();
+            }
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+
+        if (options.numa_node >= 0) {
+            ULONGLONG node_mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(options.numa_node), &node_mask) || node_mask == 0) {
+                throw SerialErrorThreadConfig();
+            }
+            mask = mask != 0 ? mask & static_cast<DWORD_PTR>(node_mask) : static_cast<DWORD_PTR>(node_mask);
+            if (mask == 0) {
+                throw SerialErrorThreadConfig(); //none of the cpus belongs to the node
+            }
+        }
+
+        if (mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+            throw SerialErrorThreadConfig();
+        }
+
+        //windows has no fifo class, time critical is the closest within the process
+        if (options.priority != 0 && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            throw SerialErrorThreadConfig();
+        }
+
+        if (options.prefault_stack_bytes != 0) {
+            //the stack grows down, what is left lies between here and its lowest address
+            ULONG_PTR low, high;
+            GetCurrentThreadStackLimits(&low, &high);
+            char here;
+            auto left = static_cast<size_t>(reinterpret_cast<ULONG_PTR>(&here) - low);
+            if (options.prefault_stack_bytes + stack_margin > left) {
+                throw SerialErrorThreadConfig();
+            }
+
+            auto stack = static_cast<volatile char*>(_alloca(options.prefault_stack_bytes));
+            for (size_t i = 0; i < options.prefault_stack_bytes; i += 4096) {
+                stack[i] = 0;
+            }
+        }
+    }
+
+    void lock_memory()
+    {
+        //no process wide equivalent of mlockall
+        throw SerialErrorThreadConfig();
+    }
+
+}
@@ -0,0 +1,490 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/traffic_log.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+namespace ssp
+{
+    namespace {
+
+        struct FormatTables {
+            std::array<char, 512> hex;
+            std::array<char, 256> ascii;
+
+            FormatTables()
+            {
+                static char const digits[] = "0123456789abcdef";
+                for (auto i = 0; i < 256; ++i) {
+                    hex[2 * i] = digits[i >> 4];
+                    hex[2 * i + 1] = digits[i & 0x0f];
+                    ascii[i] = (i >= 0x20 && i < 0x7f) ? static_cast<char>(i) : '.';
+                }
+            }
+        };
+
+        auto tables() -> FormatTables const&
+        {
+            static FormatTables const retval;
+            return retval;
+        }
+
+        enum RecordType : uint8_t {
+            RECORD_RX,
+            RECORD_TX,
+            RECORD_SUPPRESSED
+        };
+
+        struct Tap {
+            uint32_t id;
+            std::string name;
+            TrafficLimit limit;
+            std::mutex mutex;
+            double tokens;
+            std::chrono::steady_clock::time_point refilled;
+            uint64_t suppressed_events = 0;
+            uint64_t suppressed_bytes = 0;
+        };
+
+        struct RecordHeader {
+            int64_t time_us;    //since the epoch
+            uint32_t tap;
+            uint32_t len;
+            uint8_t type;
+        };
+
+        auto format_decimal(uint64_t value, char *out) -> size_t
+        {
+            char temp[20];
+            size_t len = 0;
+            do {
+                temp[len++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            for (size_t i = 0; i < len; ++i) {
+                out[i] = temp[len - 1 - i];
+            }
+            return len;
+        }
+
+        auto append(char *out, char const *text) -> size_t
+        {
+            auto len = strlen(text);
+            memcpy(out, text, len);
+            return len;
+        }
+    }
+
+    auto format_hex(uint8_t const *data, size_t len, char *out) -> size_t
+    {
+        if (len == 0) {
+            return 0;
+        }
+        auto const &hex = tables().hex;
+        for (size_t i = 0; i < len; ++i) {
+            memcpy(out + 3 * i, &hex[2 * data[i]], 2);
+            out[3 * i + 2] = ' ';
+        }
+        return 3 * len - 1;
+    }
+
+    auto format_ascii(uint8_t const *data, size_t len, char *out) -> size_t
+    {
+        auto const &ascii = tables().ascii;
+        for (size_t i = 0; i < len; ++i) {
+            out[i] = ascii[data[i]];
+        }
+        return len;
+    }
+
+    class TrafficLogger::impl {
+
+        TrafficLoggerOptions options_;
+        std::FILE *file_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable written_;
+        std::vector<uint8_t> capture_;
+        std::vector<uint8_t> standby_;
+        size_t captured_ = 0;
+        std::vector<std::shared_ptr<Tap>> taps_;
+        uint64_t requested_ = 0;    //flush generations
+        uint64_t completed_ = 0;
+        bool stopping_ = false;
+        std::chrono::steady_clock::time_point signalled_{};    //first wake request of the batch
+
+        std::vector<char> text_;
+        int64_t cached_second_ = -1;
+        char cached_prefix_[32];
+
+        std::atomic<uint64_t> events_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> rate_limited_{0};
+        std::atomic<uint64_t> overflows_{0};
+        std::atomic<uint64_t> file_writes_{0};
+        std::atomic<uint64_t> write_errors_{0};
+        LatencyRecorder wakeups_;
+
+        std::thread thread_;
+
+    public:
+        explicit impl(TrafficLoggerOptions const &options) :
+            options_{options},
+            capture_(options.buffer_bytes),
+            standby_(options.buffer_bytes),
+            text_(64 * 1024)
+        {
+            if ((file_ = std::fopen(options.path.c_str(), "ab")) == nullptr) {
+                throw SerialErrorOpening();
+            }
+            //batches are written whole, stdio buffering would only split them
+            std::setvbuf(file_, nullptr, _IONBF, 0);
+            try {
+                thread_ = start_thread(options.thread, [this] { run(); });
+            } catch (...) {
+                std::fclose(file_);
+                throw;
+            }
+        }
+
+        ~impl()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            thread_.join();
+            std::fclose(file_);
+        }
+
+        auto add_tap(std::string const &name, TrafficLimit const &limit) -> std::shared_ptr<Tap>
+        {
+            auto tap = std::make_shared<Tap>();
+            tap->name = name;
+            tap->limit = limit;
+            tap->tokens = static_cast<double>(limit.burst_bytes);
+            tap->refilled = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            tap->id = static_cast<uint32_t>(taps_.size());
+            taps_.push_back(tap);
+            return tap;
+        }
+
+        void capture(Tap &tap, RecordType type, std::vector<uint8_t> const &data)
+        {
+            uint64_t suppressed_events = 0;
+            uint64_t suppressed_bytes = 0;
+            if (tap.limit.bytes_per_second != 0) {
+                std::lock_guard<std::mutex> lock(tap.mutex);
+                auto now = std::chrono::steady_clock::now();
+                auto elapsed = std::chrono::duration<double>(now - tap.refilled).count();
+                tap.refilled = now;
+                tap.tokens = std::min(static_cast<double>(tap.limit.burst_bytes),
+                                      tap.tokens + elapsed * tap.limit.bytes_per_second);
+                //an event larger than the burst passes only with a full bucket
+                if (tap.tokens < data.size() && tap.tokens < tap.limit.burst_bytes) {
+                    ++tap.suppressed_events;
+                    tap.suppressed_bytes += data.size();
+                    ++rate_limited_;
+                    return;
+                }
+                tap.tokens -= data.size();
+                suppressed_events = tap.suppressed_events;
+                suppressed_bytes = tap.suppressed_bytes;
+                tap.suppressed_events = 0;
+                tap.suppressed_bytes = 0;
+            }
+
+            auto now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (suppressed_events != 0) {
+                uint64_t counts[2] = {suppressed_events, suppressed_bytes};
+                if (!put(RecordHeader{now_us, tap.id, sizeof(counts), RECORD_SUPPRESSED}, reinterpret_cast<uint8_t const*>(counts))) {
+                    //the summary is retried with the next event of the tap
+                    ++overflows_;
+                    std::lock_guard<std::mutex> tap_lock(tap.mutex);
+                    tap.suppressed_events += suppressed_events;
+                    tap.suppressed_bytes += suppressed_bytes;
+                }
+            }
+            if (!put(RecordHeader{now_us, tap.id, static_cast<uint32_t>(data.size()), type}, data.data())) {
+                ++overflows_;
+                return;
+            }
+            ++events_;
+            bytes_ += data.size();
+            if (captured_ > capture_.size() / 2) {
+                signal();
+                lock.unlock();
+                wake_.notify_one();
+            }
+        }
+
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto generation = ++requested_;
+            signal();
+            wake_.notify_one();
+            written_.wait(lock, [&] { return completed_ >= generation; });
+        }
+
+        auto stats() const -> TrafficLoggerStats
+        {
+            TrafficLoggerStats retval;
+            retval.events = events_.load();
+            retval.bytes = bytes_.load();
+            retval.rate_limited = rate_limited_.load();
+            retval.overflows = overflows_.load();
+            retval.file_writes = file_writes_.load();
+            retval.write_errors = write_errors_.load();
+            retval.wakeup_latency = wakeups_.snapshot();
+            return retval;
+        }
+
+    private:
+        //called with mutex_ held
+        void signal()
+        {
+            if (signalled_ == std::chrono::steady_clock::time_point{}) {
+                signalled_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        //called with mutex_ held
+        auto put(RecordHeader const &header, uint8_t const *payload) -> bool
+        {
+            if (captured_ + sizeof(header) + header.len > capture_.size()) {
+                return false;
+            }
+            memcpy(capture_.data() + captured_, &header, sizeof(header));
+            memcpy(capture_.data() + captured_ + sizeof(header), payload, header.len);
+            captured_ += sizeof(header) + header.len;
+            return true;
+        }
+
+        void run()
+        {
+            std::vector<std::shared_ptr<Tap>> taps;
+            auto interval = std::chrono::milliseconds(options_.flush_interval_ms);
+
+            while (true) {
+                size_t len;
+                uint64_t generation;
+                bool stopping;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    auto deadline = std::chrono::steady_clock::now() + interval;
+                    wake_.wait_until(lock, deadline, [this] {
+                        return stopping_ || requested_ > completed_ || captured_ > capture_.size() / 2;
+                    });
+                    record_wakeup(deadline);
+                    std::swap(capture_, standby_);
+                    len = captured_;
+                    captured_ = 0;
+                    generation = requested_;
+                    stopping = stopping_;
+                    taps = taps_;
+                }
+
+                write_batch(standby_.data(), len, taps);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    completed_ = generation;
+                }
+                written_.notify_all();
+
+                if (stopping) {
+                    return;
+                }
+            }
+        }
+
+        //called with mutex_ held
+        void record_wakeup(std::chrono::steady_clock::time_point deadline)
+        {
+            auto due = signalled_ != std::chrono::steady_clock::time_point{} ? std::min(signalled_, deadline) : deadline;
+            auto now = std::chrono::steady_clock::now();
+            if (now >= due) {
+                wakeups_.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count()));
+            }
+            signalled_ = std::chrono::steady_clock::time_point{};
+        }
+
+        void write_batch(uint8_t const *records, size_t len, std::vector<std::shared_ptr<Tap>> const &taps)
+        {
+            size_t used = 0;
+            size_t offset = 0;
+            while (offset < len) {
+                RecordHeader header;
+                memcpy(&header, records + offset, sizeof(header));
+                auto payload = records + offset + sizeof(header);
+                offset += sizeof(header) + header.len;
+
+                auto const &name = taps[header.tap]->name;
+                auto needed = 64 + name.size() + 4 * static_cast<size_t>(header.len);
+                if (text_.size() - used < needed) {
+                    write_text(used);
+                    used = 0;
+                    if (text_.size() < needed) {
+                        text_.resize(needed);
+                    }
+                }
+                used += format_record(header, payload, name, text_.data() + used);
+            }
+            write_text(used);
+        }
+
+        auto format_record(RecordHeader const &header, uint8_t const *payload, std::string const &name, char *out) -> size_t
+        {
+            auto start = out;
+            out += format_time(header.time_us, out);
+            *out++ = ' ';
+            memcpy(out, name.data(), name.size());
+            out += name.size();
+
+            if (header.type == RECORD_SUPPRESSED) {
+                uint64_t counts[2];
+                memcpy(counts, payload, sizeof(counts));
+                out += append(out, " rate limited, ");
+                out += format_decimal(counts[0], out);
+                out += append(out, " events and ");
+                out += format_decimal(counts[1], out);
+                out += append(out, " bytes not logged\n");
+                return out - start;
+            }
+
+            out += append(out, header.type == RECORD_RX ? " RX " : " TX ");
+            out += format_decimal(header.len, out);
+            *out++ = ':';
+            if (header.len != 0) {
+                *out++ = ' ';
+                out += format_hex(payload, header.len, out);
+                if (options_.ascii) {
+                    out += append(out, " |");
+                    out += format_ascii(payload, header.len, out);
+                    *out++ = '|';
+                }
+            }
+            *out++ = '\n';
+            return out - start;
+        }
+
+        //"YYYY-MM-DDTHH:MM:SS.uuuuuuZ", the part up to the seconds is cached
+        auto format_time(int64_t time_us, char *out) -> size_t
+        {
+            auto seconds = time_us / 1000000;
+            if (seconds != cached_second_) {
+                auto t = static_cast<std::time_t>(seconds);
+                struct tm parts;
+#ifdef _WIN32
+                gmtime_s(&parts, &t);
+#else
+                gmtime_r(&t, &parts);
+#endif
+                std::strftime(cached_prefix_, sizeof(cached_prefix_), "%Y-%m-%dT%H:%M:%S.", &parts);
+                cached_second_ = seconds;
+            }
+            auto len = append(out, cached_prefix_);
+            auto micros = static_cast<unsigned>(time_us % 1000000);
+            for (auto i = 5; i >= 0; --i) {
+                out[len + i] = static_cast<char>('0' + micros % 10);
+                micros /= 10;
+            }
+            out[len + 6] = 'Z';
+            return len + 7;
+        }
+
+        void write_text(size_t len)
+        {
+            if (len == 0) {
+                return;
+            }
+            ++file_writes_;
+            if (std::fwrite(text_.data(), 1, len, file_) != len) {
+                ++write_errors_;
+                std::clearerr(file_);
+            }
+        }
+    };
+
+    TrafficLogger::TrafficLogger(TrafficLoggerOptions const &options) :
+        pimpl_{std::make_shared<impl>(options)} {};
+
+    TrafficLogger::~TrafficLogger() = default;
+
+    auto TrafficLogger::tap(std::string const &name,
+                            TrafficDirection direction,
+                            TrafficLimit const &limit) -> std::function<void(const std::vector<uint8_t>&)> {
+        auto state = pimpl_->add_tap(name, limit);
+        auto type = direction == TrafficDirection::RX ? RECORD_RX : RECORD_TX;
+        auto logger = std::weak_ptr<impl>(pimpl_);
+        return [logger, state, type](const std::vector<uint8_t> &data) {
+            if (auto impl = logger.lock()) {
+                impl->capture(*state, type, data);
+            }
+        };
+    }
+
+    void TrafficLogger::attach(SerialPort &port, std::string const &name, TrafficLimit const &limit) {
+        auto state = pimpl_->add_tap(name, limit);
+        auto logger = std::weak_ptr<impl>(pimpl_);
+        port.install_rx_listener([logger, state](const std::vector<uint8_t> &data) {
+            if (auto impl = logger.lock()) {
+                impl->capture(*state, RECORD_RX, data);
+            }
+        });
+        port.install_tx_listener([logger, state](const std::vector<uint8_t> &data) {
+            if (auto impl = logger.lock()) {
+                impl->capture(*state, RECORD_TX, data);
+            }
+        });
+    }
+
+    void TrafficLogger::flush() {
+        pimpl_->flush();
+    }
+
+    auto TrafficLogger::stats() const -> TrafficLoggerStats {
+        return pimpl_->stats();
+    }
+
+}
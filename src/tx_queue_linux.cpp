@@ -0,0 +1,306 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Paulo Faco (paulofaco@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+///@file
+
+#include "ssp/tx_queue.h"
+#include <sys/uio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ssp
+{
+    class TxQueue::impl {
+
+        struct Frame {
+            std::vector<uint8_t> data;
+            std::function<void(std::exception_ptr)> on_complete;
+            std::chrono::steady_clock::time_point queued;
+        };
+
+        int fd_;
+        TxQueueOptions options_;
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::condition_variable idle_;
+        std::deque<Frame> queue_;
+        size_t queued_bytes_ = 0;
+        bool busy_ = false;
+        bool stopping_ = false;
+        std::function<void(const std::vector<uint8_t>&)> tx_listener_ = nullptr;
+
+        std::atomic<uint64_t> frames_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> writes_{0};
+        std::atomic<uint64_t> partial_writes_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<size_t> pending_{0};   //queue size, polled without the lock
+        LatencyRecorder wakeups_;
+
+        std::vector<struct iovec> iov_;
+        std::thread thread_;
+
+    public:
+        impl(SerialPort &port, TxQueueOptions const &options) :
+            fd_{port.native_handle()},
+            options_{options}
+        {
+            thread_ = start_thread(options.thread, [this] { run(); });
+        }
+
+        ~impl()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            not_empty_.notify_all();
+            not_full_.notify_all();
+            thread_.join();
+        }
+
+        auto submit(std::vector<uint8_t> frame, std::function<void(std::exception_ptr)> on_complete) -> bool
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (queue_.size() >= options_.max_frames) {
+                    if (options_.backpressure == Backpressure::REJECT) {
+                        ++rejected_;
+                        return false;
+                    }
+                    not_full_.wait(lock, [this] { return queue_.size() < options_.max_frames || stopping_; });
+                }
+                if (stopping_) {
+                    ++rejected_;
+                    return false;
+                }
+                queued_bytes_ += frame.size();
+                queue_.push_back(Frame{std::move(frame), std::move(on_complete), std::chrono::steady_clock::now()});
+                pending_.store(queue_.size(), std::memory_order_release);
+            }
+            not_empty_.notify_one();
+            return true;
+        }
+
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+        }
+
+        void install_tx_listener(std::function<void(const std::vector<uint8_t>&)> func)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tx_listener_ = func;
+        }
+
+        auto stats() const -> TxQueueStats
+        {
+            TxQueueStats retval;
+            retval.frames = frames_.load();
+            retval.bytes = bytes_.load();
+            retval.writes = writes_.load();
+            retval.partial_writes = partial_writes_.load();
+            retval.rejected = rejected_.load();
+            retval.wakeup_latency = wakeups_.snapshot();
+            return retval;
+        }
+
+    private:
+        void run()
+        {
+            //sized up front so that transmitting never allocates
+            std::vector<Frame> batch;
+            batch.reserve(std::min<size_t>(options_.max_frames, IOV_MAX));
+            iov_.reserve(batch.capacity());
+            std::function<void(const std::vector<uint8_t>&)> listener;
+
+            while (true) {
+                auto idle = pending_.load(std::memory_order_acquire) == 0;
+                if (idle && options_.thread.busy_poll_us != 0) {
+                    busy_poll(options_.thread.busy_poll_us, [this] {
+                        return pending_.load(std::memory_order_acquire) != 0;
+                    });
+                }
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    not_empty_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                    if (queue_.empty()) {
+                        return;
+                    }
+                    if (idle) {
+                        //the oldest frame arrived while the thread was waiting for work
+                        auto latency = std::chrono::steady_clock::now() - queue_.front().queued;
+                        wakeups_.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+                    }
+
+                    //give the oldest frame's latency budget to others to join the batch
+                    if (options_.max_batch_delay_us != 0 && !stopping_) {
+                        auto deadline = queue_.front().queued + std::chrono::microseconds(options_.max_batch_delay_us);
+                        not_empty_.wait_until(lock, deadline, [this] {
+                            return queued_bytes_ >= options_.max_batch_bytes || stopping_;
+                        });
+                    }
+
+                    size_t bytes = 0;
+                    while (!queue_.empty() && batch.size() < IOV_MAX &&
+                           (batch.empty() || bytes + queue_.front().data.size() <= options_.max_batch_bytes)) {
+                        bytes += queue_.front().data.size();
+                        batch.push_back(std::move(queue_.front()));
+                        queue_.pop_front();
+                    }
+                    queued_bytes_ -= bytes;
+                    pending_.store(queue_.size(), std::memory_order_relaxed);
+                    busy_ = true;
+                    listener = tx_listener_;
+                }
+                not_full_.notify_all();
+
+                transmit(batch, listener);
+                batch.clear();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    busy_ = false;
+                    if (queue_.empty()) {
+                        idle_.notify_all();
+                    }
+                }
+            }
+        }
+
+        void transmit(std::vector<Frame> &batch, std::function<void(const std::vector<uint8_t>&)> const &listener)
+        {
+            iov_.resize(batch.size());
+            size_t remaining = 0;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                iov_[i].iov_base = batch[i].data.data();
+                iov_[i].iov_len = batch[i].data.size();
+                remaining += batch[i].data.size();
+            }
+
+            size_t first = 0;   //first frame not completely written
+            while (first < batch.size()) {
+                auto res = remaining != 0 ? writev(fd_, &iov_[first], static_cast<int>(iov_.size() - first)) : 0;
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if ((res < 0 && errno == EAGAIN) || (res == 0 && remaining != 0)) {
+                    struct pollfd pfd = {fd_, POLLOUT, 0};
+                    poll(&pfd, 1, -1);
+                    continue;
+                }
+                if (res < 0) {
+                    auto error = std::make_exception_ptr(SerialErrorIO());
+                    for (; first < batch.size(); ++first) {
+                        if (batch[first].on_complete != nullptr) {
+                            batch[first].on_complete(error);
+                        }
+                    }
+                    return;
+                }
+
+                if (remaining != 0) {
+                    ++writes_;
+                    if (static_cast<size_t>(res) < remaining) {
+                        ++partial_writes_;
+                    }
+                }
+                remaining -= static_cast<size_t>(res);
+
+                //complete every frame fully written, then resume mid-frame
+                auto written = static_cast<size_t>(res);
+                while (first < batch.size() && written >= iov_[first].iov_len) {
+                    written -= iov_[first].iov_len;
+                    complete(batch[first], listener);
+                    ++first;
+                }
+                if (first < batch.size()) {
+                    iov_[first].iov_base = static_cast<uint8_t*>(iov_[first].iov_base) + written;
+                    iov_[first].iov_len -= written;
+                }
+            }
+        }
+
+        void complete(Frame &frame, std::function<void(const std::vector<uint8_t>&)> const &listener)
+        {
+            ++frames_;
+            bytes_ += frame.data.size();
+            if (listener != nullptr) {
+                listener(frame.data);
+            }
+            if (frame.on_complete != nullptr) {
+                frame.on_complete(nullptr);
+            }
+        }
+    };
+
+    TxQueue::TxQueue(SerialPort &port, TxQueueOptions const &options) :
+        pimpl_{std::make_unique<impl>(port, options)} {};
+
+    TxQueue::~TxQueue() = default;
+
+    auto TxQueue::submit(std::vector<uint8_t> frame, std::function<void(std::exception_ptr)> on_complete) -> bool {
+        return pimpl_->submit(std::move(frame), std::move(on_complete));
+    }
+
+    auto TxQueue::submit_future(std::vector<uint8_t> frame) -> std::future<void> {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto retval = promise->get_future();
+        auto accepted = pimpl_->submit(std::move(frame), [promise](std::exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value();
+            }
+        });
+        if (!accepted) {
+            promise->set_exception(std::make_exception_ptr(SerialErrorQueueFull()));
+        }
+        return retval;
+    }
+
+    void TxQueue::flush() {
+        pimpl_->flush();
+    }
+
+    void TxQueue::install_tx_listener(std::function<void(const std::vector<uint8_t>&)> func) {
+        pimpl_->install_tx_listener(func);
+    }
+
+    auto TxQueue::stats() const -> TxQueueStats {
+        return pimpl_->stats();
+    }
+
+}